@@ -0,0 +1,567 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+#include "Raytracer.hpp"
+#include "Mesh.hpp"
+#include "PerfCounters.hpp"
+
+// measures BVH builds, ray throughput and castRay cost, or image error at equal render time, and writes the results as JSON
+
+// rays with the distance they are traced up to, shadow rays stop short of the light
+struct RaySet {
+	std::vector<Ray>   rays;
+	std::vector<float> tmax;
+};
+
+struct RaySets {
+	RaySet primary;
+	RaySet shadow;
+	RaySet bounce;
+	float  primary_hit_rate{};
+};
+
+const char* methodName(BVHBuildMethod method)
+{
+	switch (method) {
+	case BVHBuildMethod::NAIVE:
+		return "naive";
+	case BVHBuildMethod::SAH:
+		return "sah";
+	default:
+		return "sbvh";
+	}
+}
+
+template <typename F>
+double milliseconds(F&& f)
+{
+	auto start = std::chrono::steady_clock::now();
+	f();
+	auto stop = std::chrono::steady_clock::now();
+
+	return std::chrono::duration<double, std::milli>(stop - start).count();
+}
+
+// a displaced uv sphere with about the requested number of triangles, wound outwards
+TriangleMesh proceduralMesh(size_t triangles)
+{
+	TriangleMesh mesh;
+	mesh.materials.push_back(nullptr);
+
+	int rings = std::max(2, static_cast<int>(std::sqrt(triangles / 4.0)));
+	int segments = std::max(3, static_cast<int>(triangles / (2 * rings)));
+
+	for (int i = 0; i <= rings; i++) {
+		for (int j = 0; j <= segments; j++) {
+			float   theta = PI * i / rings;
+			float   phi = 2.f * PI * j / segments;
+			vec3f_t direction(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+			float   radius = 1.f + 0.1f * std::sin(7.f * theta) * std::cos(5.f * phi);
+			mesh.addVertex(direction * radius, direction, vec2f_t(static_cast<float>(j) / segments, static_cast<float>(i) / rings));
+		}
+	}
+
+	auto vertex = [&](int i, int j) { return static_cast<uint32_t>(i * (segments + 1) + j); };
+	auto add = [&](uint32_t a, uint32_t b, uint32_t c) {
+		vec3f_t normal = (mesh.positions[b] - mesh.positions[a]).cross(mesh.positions[c] - mesh.positions[a]);
+		if (normal.dot(mesh.positions[a] + mesh.positions[b] + mesh.positions[c]) < 0.f)
+			std::swap(b, c);
+		mesh.indices.push_back({a, b, c});
+		mesh.material_ids.push_back(0);
+	};
+
+	for (int i = 0; i < rings; i++) {
+		for (int j = 0; j < segments; j++) {
+			add(vertex(i, j), vertex(i + 1, j), vertex(i + 1, j + 1));
+			add(vertex(i, j), vertex(i + 1, j + 1), vertex(i, j + 1));
+		}
+	}
+
+	return mesh;
+}
+
+// primary rays from camera, shadow rays from their hits to light and cosine-distributed bounces off the same hits;
+// closest(ray, position, normal) returns whether the ray hits and where
+template <typename Camera, typename Closest>
+RaySets generateRays(size_t count, std::mt19937& rng, Camera&& camera, const vec3f_t& light, Closest&& closest)
+{
+	constexpr float EPSILON = 1e-4f;
+
+	std::uniform_real_distribution<float> uniform(0.f, 1.f);
+	RaySets                               sets;
+	size_t                                hits = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		Ray ray = camera(uniform(rng), uniform(rng));
+		sets.primary.rays.push_back(ray);
+		sets.primary.tmax.push_back(std::numeric_limits<float>::max());
+
+		vec3f_t position, normal;
+		if (!closest(ray, position, normal))
+			continue;
+		hits++;
+
+		if (normal.dot(ray.direction) > 0.f)
+			normal = -normal;
+
+		vec3f_t to_light = light - position;
+		float   distance = to_light.norm();
+		sets.shadow.rays.push_back(Ray(position + normal * EPSILON, to_light / distance));
+		sets.shadow.tmax.push_back(distance * (1.f - EPSILON));
+
+		// cosine-weighted direction in the hemisphere around the normal
+		float   r = std::sqrt(uniform(rng));
+		float   phi = 2.f * PI * uniform(rng);
+		vec3f_t tangent = std::abs(normal.x()) > 0.9f ? vec3f_t(0, 1, 0) : vec3f_t(1, 0, 0);
+		tangent = tangent.cross(normal).normalized();
+		vec3f_t bitangent = normal.cross(tangent);
+		vec3f_t direction = (tangent * (r * std::cos(phi)) + bitangent * (r * std::sin(phi)) + normal * std::sqrt(std::max(0.f, 1.f - r * r))).normalized();
+		sets.bounce.rays.push_back(Ray(position + normal * EPSILON, direction));
+		sets.bounce.tmax.push_back(std::numeric_limits<float>::max());
+	}
+
+	sets.primary_hit_rate = count ? static_cast<float>(hits) / count : 0.f;
+	return sets;
+}
+
+// million rays per second through trace(ray, tmax), followed by hardware counts per ray when they are available
+template <typename F>
+std::string throughput(const char* name, const RaySet& set, F&& trace)
+{
+	if (set.rays.empty())
+		return std::string("\"") + name + "_mrays\": 0";
+
+	size_t     hits = 0;
+	PerfSample counters;
+	double     ms = 0.0;
+	{
+		PerfScope scope(counters);
+		ms = milliseconds([&]() {
+			for (size_t i = 0; i < set.rays.size(); i++)
+				hits += trace(set.rays[i], set.tmax[i]);
+		});
+	}
+
+	// keeps the traversal from being optimized away
+	if (hits > set.rays.size())
+		std::cerr << "unexpected hit count" << std::endl;
+
+	std::ostringstream json;
+	double             rays = static_cast<double>(set.rays.size());
+	json << "\"" << name << "_mrays\": " << rays / (ms * 1e3);
+	if (counters.cycles > 0) {
+		json << ", \"" << name << "_ipc\": " << counters.ipc()
+		     << ", \"" << name << "_l1_misses_per_ray\": " << counters.l1_misses / rays
+		     << ", \"" << name << "_llc_misses_per_ray\": " << counters.llc_misses / rays
+		     << ", \"" << name << "_branch_misses_per_ray\": " << counters.branch_misses / rays;
+	}
+
+	return json.str();
+}
+
+std::string benchmarkMesh(size_t triangles, size_t ray_count, const std::vector<BVHBuildMethod>& methods)
+{
+	TriangleMesh mesh = proceduralMesh(triangles);
+
+	std::vector<Bound> bounds(mesh.size());
+	std::vector<float> areas(mesh.size());
+	Bound              total{};
+	for (uint32_t i = 0; i < mesh.size(); i++) {
+		bounds[i] = mesh.bound(i);
+		areas[i] = mesh.area(i);
+		total = Bound::merge(total, bounds[i]);
+	}
+
+	auto build = [&](BVHBuildMethod method) {
+		BVHBuildOptions options{4};
+		options.method = method;
+		options.clip = [&](uint32_t id, const Bound& box) { return mesh.clip(id, box); };
+		return std::make_unique<BVHAccel>(bounds, areas, options);
+	};
+
+	// every method traces the same rays, generated against a SAH tree
+	std::mt19937 rng(7);
+	auto         reference = build(BVHBuildMethod::SAH);
+	vec3f_t      center = total.centroid();
+	float        extent = total.diagonal().norm();
+	vec3f_t      eye = center + vec3f_t(0.3f, 0.4f, -2.f) * extent;
+	vec3f_t      light = center + vec3f_t(0.f, 1.5f, -1.f) * extent;
+
+	auto camera = [&](float x, float y) {
+		vec3f_t target = center + vec3f_t(x - 0.5f, y - 0.5f, 0.f) * extent * 0.6f;
+		return Ray(eye, (target - eye).normalized());
+	};
+	auto closest = [&](const Ray& ray, vec3f_t& position, vec3f_t& normal) {
+		HitRecord hit;
+		if (!reference->intersect(ray, hit, [&](uint32_t id, HitRecord& closest) { return mesh.intersect(id, ray, closest); }))
+			return false;
+		position = ray.at(hit.t);
+		normal = mesh.geometricNormal(hit.prim_id);
+		return true;
+	};
+	RaySets sets = generateRays(ray_count, rng, camera, light, closest);
+	reference.reset();
+
+	std::ostringstream json;
+	json << "{\"name\": \"procedural\", \"triangles\": " << mesh.size() << ", \"primary_hit_rate\": " << sets.primary_hit_rate << ", \"methods\": [";
+
+	for (size_t m = 0; m < methods.size(); m++) {
+		std::unique_ptr<BVHAccel> bvh;
+		double                    build_ms = milliseconds([&]() { bvh = build(methods[m]); });
+
+		auto trace = [&](const Ray& ray, float tmax) {
+			HitRecord hit;
+			hit.t = tmax;
+			return bvh->intersect(ray, hit, [&](uint32_t id, HitRecord& closest) { return mesh.intersect(id, ray, closest); });
+		};
+
+		json << (m ? ", " : "") << "{\"method\": \"" << methodName(methods[m]) << "\""
+		     << ", \"build_ms\": " << build_ms
+		     << ", \"sah_cost\": " << bvh->cost()
+		     << ", \"memory_bytes\": " << bvh->memoryUsage()
+		     << ", " << throughput("primary", sets.primary, trace)
+		     << ", " << throughput("shadow", sets.shadow, trace)
+		     << ", " << throughput("bounce", sets.bounce, trace) << "}";
+	}
+	json << "]}";
+
+	return json.str();
+}
+
+std::string benchmarkScene(const std::string& path, size_t ray_count, int spp, const std::vector<BVHBuildMethod>& methods)
+{
+	std::ostringstream json;
+	json << "{\"name\": \"" << std::filesystem::path(path).stem().string() << "\", \"methods\": [";
+
+	for (size_t m = 0; m < methods.size(); m++) {
+		// models load lazily so buildBVH below times every hierarchy of the scene
+		Scene scene;
+		scene.bvh_options.method = methods[m];
+		scene.bvh_options.lazy = true;
+		scene.load(path);
+		scene.bvh_options.lazy = false;
+		double build_ms = milliseconds([&]() { scene.buildBVH(); });
+
+		size_t triangles = scene.triangles.size();
+		for (auto* model : scene.models)
+			triangles += model->mesh.size();
+
+		Raytracer raytracer;
+		raytracer.setup(scene);
+
+		std::mt19937 rng(7);
+		auto         camera = [&](float x, float y) { return raytracer.cameraRay(x * scene.width, y * scene.height); };
+		auto         closest = [&](const Ray& ray, vec3f_t& position, vec3f_t& normal) {
+			Intersection hit = scene.intersect(ray);
+			position = hit.position;
+			normal = hit.normal.normalized();
+			return hit.hit;
+		};
+
+		Intersection light{};
+		float        light_pdf{};
+		scene.sampleLight(light, light_pdf);
+		RaySets sets = generateRays(ray_count, rng, camera, light.position, closest);
+
+		auto trace = [&](const Ray& ray, float tmax) {
+			Intersection hit = scene.intersect(ray);
+			return hit.hit && hit.distance < tmax;
+		};
+
+		// the whole frame through castRay on one thread, as a tile would render it
+		double frame_ms = milliseconds([&]() {
+			for (int j = 0; j < scene.height; j++)
+				for (int i = 0; i < scene.width; i++)
+					for (int k = 0; k < spp; k++)
+						scene.castRay(raytracer.cameraRay(i + 0.5f, j + 0.5f), 0);
+		});
+		double samples = static_cast<double>(scene.width) * scene.height * spp;
+
+		json << (m ? ", " : "") << "{\"method\": \"" << methodName(methods[m]) << "\""
+		     << ", \"triangles\": " << triangles
+		     << ", \"build_ms\": " << build_ms
+		     << ", \"sah_cost\": " << scene.bvh->cost()
+		     << ", \"primary_hit_rate\": " << sets.primary_hit_rate
+		     << ", " << throughput("primary", sets.primary, trace)
+		     << ", " << throughput("shadow", sets.shadow, trace)
+		     << ", " << throughput("bounce", sets.bounce, trace)
+		     << ", \"width\": " << scene.width << ", \"height\": " << scene.height << ", \"spp\": " << spp
+		     << ", \"frame_ms\": " << frame_ms
+		     << ", \"castray_us\": " << frame_ms * 1e3 / samples << "}";
+	}
+	json << "]}";
+
+	return json.str();
+}
+
+// one progressive pass of a sample per pixel through castRay, added to accumulation on the calling thread
+void renderPass(const Scene& scene, const Raytracer& raytracer, std::vector<vec3f_t>& accumulation)
+{
+	for (int j = 0; j < scene.height; j++)
+		for (int i = 0; i < scene.width; i++)
+			accumulation[j * scene.width + i] += scene.castRay(raytracer.cameraRay(i + 0.5f, j + 0.5f), 0);
+}
+
+// linear radiance as a little-endian PFM, rows stored bottom to top
+void writePfm(const std::string& filename, int width, int height, const std::vector<vec3f_t>& image)
+{
+	std::ofstream file(filename, std::ios::binary);
+	if (!file.is_open())
+		throw std::runtime_error("Failed to open reference for writing: " + filename);
+
+	file << "PF\n"
+	     << width << " " << height << "\n-1.0\n";
+	for (int j = height - 1; j >= 0; j--)
+		for (int i = 0; i < width; i++)
+			file.write(reinterpret_cast<const char*>(image[j * width + i].data()), 3 * sizeof(float));
+}
+
+std::vector<vec3f_t> readPfm(const std::string& filename, int width, int height)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file.is_open())
+		throw std::runtime_error("Failed to open reference: " + filename);
+
+	std::string magic;
+	int         file_width = 0, file_height = 0;
+	float       scale = 0.f;
+	file >> magic >> file_width >> file_height >> scale;
+	file.get();
+	if (magic != "PF" || scale >= 0.f)
+		throw std::runtime_error("Expected a little-endian color PFM: " + filename);
+	if (file_width != width || file_height != height)
+		throw std::runtime_error("Reference is " + std::to_string(file_width) + "x" + std::to_string(file_height) + ", scene renders " + std::to_string(width) + "x" + std::to_string(height));
+
+	std::vector<vec3f_t> image(width * height);
+	for (int j = height - 1; j >= 0; j--)
+		for (int i = 0; i < width; i++)
+			file.read(reinterpret_cast<char*>(image[j * width + i].data()), 3 * sizeof(float));
+	if (!file)
+		throw std::runtime_error("Reference is truncated: " + filename);
+
+	return image;
+}
+
+// rmse over all channels, and relMSE which divides each squared error by the squared reference so dark
+// and bright regions weigh alike
+void imageError(const std::vector<vec3f_t>& accumulation, int spp, const std::vector<vec3f_t>& reference, double& rmse, double& relmse)
+{
+	constexpr double EPSILON = 1e-2;
+
+	double squared = 0.0, relative = 0.0;
+	for (size_t i = 0; i < reference.size(); i++) {
+		vec3f_t estimate = accumulation[i] / static_cast<float>(spp);
+		for (int c = 0; c < 3; c++) {
+			double error = static_cast<double>(estimate[c]) - reference[i][c];
+			squared += error * error;
+			relative += error * error / (static_cast<double>(reference[i][c]) * reference[i][c] + EPSILON);
+		}
+	}
+
+	double count = 3.0 * reference.size();
+	rmse = std::sqrt(squared / count);
+	relmse = relative / count;
+}
+
+// renders progressively, one sample per pixel at a time, and records the error of the image as it stands once
+// each time budget has passed, so methods compare by how close they get to the reference in the same time
+std::string convergenceScene(const std::string& path, const std::vector<BVHBuildMethod>& methods, const std::vector<double>& budgets_ms,
+                             const std::string& reference_path, int reference_spp)
+{
+	Scene reference_scene;
+	reference_scene.load(path);
+
+	Raytracer raytracer;
+	raytracer.setup(reference_scene);
+
+	std::vector<vec3f_t> reference;
+	if (!reference_path.empty() && std::filesystem::exists(reference_path)) {
+		std::cerr << "Loading reference " << reference_path << std::endl;
+		reference = readPfm(reference_path, reference_scene.width, reference_scene.height);
+		reference_spp = 0;
+	} else {
+		std::cerr << "Rendering reference at " << reference_spp << " spp" << std::endl;
+		std::vector<vec3f_t> accumulation(reference_scene.width * reference_scene.height, vec3f_t::Zero());
+		for (int k = 0; k < reference_spp; k++)
+			renderPass(reference_scene, raytracer, accumulation);
+
+		for (auto& pixel : accumulation)
+			pixel /= static_cast<float>(reference_spp);
+		reference = std::move(accumulation);
+
+		if (!reference_path.empty())
+			writePfm(reference_path, reference_scene.width, reference_scene.height, reference);
+	}
+
+	std::ostringstream json;
+	json << "{\"name\": \"" << std::filesystem::path(path).stem().string() << "\""
+	     << ", \"width\": " << reference_scene.width << ", \"height\": " << reference_scene.height;
+	if (reference_spp > 0)
+		json << ", \"reference_spp\": " << reference_spp;
+	json << ", \"methods\": [";
+
+	for (size_t m = 0; m < methods.size(); m++) {
+		std::cerr << "Converging with " << methodName(methods[m]) << std::endl;
+
+		// the BVH build counts against the budget, it is part of getting to the image
+		std::vector<vec3f_t> accumulation(reference.size(), vec3f_t::Zero());
+		std::ostringstream   points;
+		double               elapsed_ms = 0.0;
+		int                  spp = 0;
+		Scene                scene;
+
+		elapsed_ms += milliseconds([&]() {
+			scene.bvh_options.method = methods[m];
+			scene.load(path);
+		});
+
+		for (size_t b = 0; b < budgets_ms.size(); b++) {
+			while (elapsed_ms < budgets_ms[b] || spp == 0) {
+				elapsed_ms += milliseconds([&]() { renderPass(scene, raytracer, accumulation); });
+				spp++;
+			}
+
+			double rmse, relmse;
+			imageError(accumulation, spp, reference, rmse, relmse);
+			points << (b ? ", " : "") << "{\"budget_ms\": " << budgets_ms[b] << ", \"ms\": " << elapsed_ms << ", \"spp\": " << spp
+			       << ", \"rmse\": " << rmse << ", \"relmse\": " << relmse << "}";
+		}
+
+		json << (m ? ", " : "") << "{\"method\": \"" << methodName(methods[m]) << "\", \"points\": [" << points.str() << "]}";
+	}
+	json << "]}";
+
+	return json.str();
+}
+
+void usage(const char* program)
+{
+	std::cerr << "Usage: " << program << " [options]\n"
+	          << "  --output <file>                    write the JSON results to <file> instead of stdout\n"
+	          << "  --min-triangles <n>                smallest procedural mesh, sizes grow tenfold\n"
+	          << "  --max-triangles <n>                largest procedural mesh\n"
+	          << "  --rays <n>                         rays per primary, shadow and bounce set\n"
+	          << "  --spp <n>                          samples per pixel of the castRay frame\n"
+	          << "  --scene <file>                     scene for the castRay frame, the Cornell box by default\n"
+	          << "  --bvh <naive|sah|sbvh>[,...]       build methods to compare\n"
+	          << "  --convergence <ms>[,...]           only measure image error of --scene at these render time budgets\n"
+	          << "  --reference <file>                 PFM reference for --convergence, rendered and written when missing\n"
+	          << "  --reference-spp <n>                samples per pixel of a rendered reference" << std::endl;
+}
+
+int main(int argc, const char* argv[])
+{
+	std::string output_path;
+	std::string scene_path = PROJECT_PATH "/assets/cornellbox/cornellbox.scene";
+	size_t      min_triangles = 1000;
+	size_t      max_triangles = 1000000;
+	std::string reference_path;
+	size_t      ray_count = 1 << 16;
+	int         spp = 4;
+	int         reference_spp = 1024;
+
+	std::vector<double>         budgets_ms;
+
+	std::vector<BVHBuildMethod> methods = {BVHBuildMethod::NAIVE, BVHBuildMethod::SAH, BVHBuildMethod::SBVH};
+
+	try {
+		for (int i = 1; i < argc; i++) {
+			std::string arg = argv[i];
+			if (i + 1 >= argc) {
+				usage(argv[0]);
+				return 1;
+			}
+
+			std::string value = argv[++i];
+			if (arg == "--output")
+				output_path = value;
+			else if (arg == "--min-triangles")
+				min_triangles = std::stoull(value);
+			else if (arg == "--max-triangles")
+				max_triangles = std::stoull(value);
+			else if (arg == "--rays")
+				ray_count = std::stoull(value);
+			else if (arg == "--spp")
+				spp = std::stoi(value);
+			else if (arg == "--scene")
+				scene_path = value;
+			else if (arg == "--bvh") {
+				methods.clear();
+				std::stringstream stream(value);
+				for (std::string name; std::getline(stream, name, ',');) {
+					if (name == "naive")
+						methods.push_back(BVHBuildMethod::NAIVE);
+					else if (name == "sah")
+						methods.push_back(BVHBuildMethod::SAH);
+					else if (name == "sbvh")
+						methods.push_back(BVHBuildMethod::SBVH);
+					else
+						throw std::invalid_argument("unknown build method " + name);
+				}
+			} else if (arg == "--convergence") {
+				std::stringstream stream(value);
+				for (std::string budget; std::getline(stream, budget, ',');)
+					budgets_ms.push_back(std::stod(budget));
+				std::sort(budgets_ms.begin(), budgets_ms.end());
+			} else if (arg == "--reference")
+				reference_path = value;
+			else if (arg == "--reference-spp")
+				reference_spp = std::max(1, std::stoi(value));
+			else {
+				usage(argv[0]);
+				return 1;
+			}
+		}
+	} catch (const std::exception& e) {
+		std::cerr << "Invalid argument: " << e.what() << std::endl;
+		usage(argv[0]);
+		return 1;
+	}
+
+	// hardware counters are reported per ray set when the build and the kernel provide them
+	PerfCounters::enabled = PerfCounters::local().available();
+
+	std::ostringstream json;
+	if (!budgets_ms.empty()) {
+		try {
+			json << "{\"threads\": 1, \"convergence\": [" << convergenceScene(scene_path, methods, budgets_ms, reference_path, reference_spp) << "]}";
+		} catch (const std::exception& e) {
+			std::cerr << "Convergence failed: " << e.what() << std::endl;
+			return 1;
+		}
+	} else {
+		json << "{\"rays\": " << ray_count << ", \"threads\": 1, \"perf_counters\": " << (PerfCounters::enabled ? "true" : "false") << ", \"meshes\": [";
+		for (size_t triangles = std::max<size_t>(min_triangles, 1); triangles <= max_triangles; triangles *= 10) {
+			std::cerr << "Benchmarking procedural mesh of " << triangles << " triangles" << std::endl;
+			json << (triangles > min_triangles ? ", " : "") << benchmarkMesh(triangles, ray_count, methods);
+		}
+		json << "], \"scenes\": [";
+
+		try {
+			std::cerr << "Benchmarking " << scene_path << std::endl;
+			json << benchmarkScene(scene_path, ray_count, spp, methods);
+		} catch (const std::exception& e) {
+			std::cerr << "Skipping scene: " << e.what() << std::endl;
+		}
+		json << "]}";
+	}
+
+	if (output_path.empty()) {
+		std::cout << json.str() << std::endl;
+		return 0;
+	}
+
+	std::ofstream file(output_path);
+	if (!file.is_open()) {
+		std::cerr << "Failed to open " << output_path << std::endl;
+		return 1;
+	}
+	file << json.str() << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,109 @@
+#include "PerfCounters.hpp"
+
+#if defined(RASYER_PERF_COUNTERS) && defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+PerfSample PerfSample::operator-(const PerfSample& other) const
+{
+	return PerfSample{
+	    cycles - other.cycles,
+	    instructions - other.instructions,
+	    l1_misses - other.l1_misses,
+	    llc_misses - other.llc_misses,
+	    branch_misses - other.branch_misses};
+}
+
+PerfSample& PerfSample::operator+=(const PerfSample& other)
+{
+	cycles += other.cycles;
+	instructions += other.instructions;
+	l1_misses += other.l1_misses;
+	llc_misses += other.llc_misses;
+	branch_misses += other.branch_misses;
+	return *this;
+}
+
+#if defined(RASYER_PERF_COUNTERS) && defined(__linux__)
+
+PerfCounters::PerfCounters()
+{
+	// cycles lead the group, the others join it when the kernel and hardware support them
+	constexpr uint64_t L1_READ_MISS = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+	const std::array<std::pair<uint32_t, uint64_t>, NUM_EVENTS> events = {{
+	    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+	    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+	    {PERF_TYPE_HW_CACHE, L1_READ_MISS},
+	    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+	    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+	}};
+
+	for (int e = 0; e < NUM_EVENTS; e++) {
+		perf_event_attr attr{};
+		attr.size = sizeof(attr);
+		attr.type = events[e].first;
+		attr.config = events[e].second;
+		attr.read_format = PERF_FORMAT_GROUP;
+		attr.disabled = group < 0;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+
+		// pid 0 and cpu -1 count the calling thread on whichever cpu it runs
+		int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group, 0));
+		if (fd < 0) {
+			if (group < 0)
+				return;
+			continue;
+		}
+
+		if (group < 0)
+			group = fd;
+		fds[e] = fd;
+		slots[e] = opened++;
+	}
+
+	ioctl(group, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(group, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+PerfCounters::~PerfCounters()
+{
+	for (int fd : fds)
+		if (fd >= 0)
+			close(fd);
+}
+
+PerfSample PerfCounters::read() const
+{
+	if (group < 0)
+		return PerfSample{};
+
+	std::array<uint64_t, NUM_EVENTS + 1> values{};
+	if (::read(group, values.data(), sizeof(values)) < static_cast<ssize_t>((opened + 1) * sizeof(uint64_t)))
+		return PerfSample{};
+
+	auto value = [&](int e) { return slots[e] >= 0 ? values[1 + slots[e]] : 0; };
+	return PerfSample{value(0), value(1), value(2), value(3), value(4)};
+}
+
+#else
+
+PerfCounters::PerfCounters() = default;
+PerfCounters::~PerfCounters() = default;
+
+PerfSample PerfCounters::read() const
+{
+	return PerfSample{};
+}
+
+#endif
+
+PerfCounters& PerfCounters::local()
+{
+	thread_local PerfCounters counters;
+	return counters;
+}
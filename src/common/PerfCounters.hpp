@@ -0,0 +1,71 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+// user-space hardware event counts between two reads
+struct PerfSample {
+	uint64_t cycles{};
+	uint64_t instructions{};
+	uint64_t l1_misses{};
+	uint64_t llc_misses{};
+	uint64_t branch_misses{};
+
+	auto ipc() const -> double { return cycles ? static_cast<double>(instructions) / cycles : 0.0; }
+
+	PerfSample  operator-(const PerfSample& other) const;
+	PerfSample& operator+=(const PerfSample& other);
+};
+
+// hardware counters of the calling thread through perf_event_open; only built with RASYER_PERF_COUNTERS
+// on Linux, elsewhere or when the kernel refuses the events every read returns zeros
+class PerfCounters {
+private:
+	static constexpr int NUM_EVENTS = 5;
+
+	// slots maps each event to its position in the group read, -1 when the event could not be opened
+	int                         group{-1};
+	std::array<int, NUM_EVENTS> fds{-1, -1, -1, -1, -1};
+	std::array<int, NUM_EVENTS> slots{-1, -1, -1, -1, -1};
+	int                         opened{0};
+
+public:
+	static inline bool enabled{false};
+
+	PerfCounters();
+	~PerfCounters();
+
+	PerfCounters(const PerfCounters&) = delete;
+	PerfCounters& operator=(const PerfCounters&) = delete;
+
+	auto available() const -> bool { return group >= 0; }
+	auto read() const -> PerfSample;
+
+	static auto local() -> PerfCounters&;
+};
+
+// adds the counts of the calling thread over its lifetime to target while counters are enabled
+class PerfScope {
+private:
+	PerfSample* target{};
+	PerfSample  begin;
+
+public:
+	PerfScope(PerfSample& target)
+	{
+		if (!PerfCounters::enabled)
+			return;
+
+		this->target = &target;
+		begin = PerfCounters::local().read();
+	}
+
+	~PerfScope()
+	{
+		if (target)
+			*target += PerfCounters::local().read() - begin;
+	}
+
+	PerfScope(const PerfScope&) = delete;
+	PerfScope& operator=(const PerfScope&) = delete;
+};
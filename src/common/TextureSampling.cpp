@@ -0,0 +1,56 @@
+#define STB_IMAGE_IMPLEMENTATION
+
+#include "TextureSampling.hpp"
+
+#include <cstring>
+#include <stb_image.h>
+
+std::vector<uint32_t> TextureSampling::decode(const std::string& file_path, int& width, int& height, int& channels)
+{
+	stbi_set_flip_vertically_on_load_thread(true);
+	auto image = stbi_load(file_path.c_str(), &width, &height, &channels, 4);
+	if (image == nullptr)
+		return {};
+
+	std::vector<uint32_t> pixels(static_cast<size_t>(width) * height);
+	std::memcpy(pixels.data(), image, pixels.size() * sizeof(uint32_t));
+	stbi_image_free(image);
+
+	return pixels;
+}
+
+std::vector<uint32_t> TextureSampling::downsample(const std::vector<uint32_t>& pixels, int width, int height)
+{
+	int                   next_width = std::max(1, width / 2);
+	int                   next_height = std::max(1, height / 2);
+	std::vector<uint32_t> next(static_cast<size_t>(next_width) * next_height);
+	for (int y = 0; y < next_height; y++) {
+		for (int x = 0; x < next_width; x++) {
+			int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+			int y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+
+			uint32_t texels[4] = {pixels[y0 * width + x0], pixels[y0 * width + x1],
+			                      pixels[y1 * width + x0], pixels[y1 * width + x1]};
+			uint32_t result = 0;
+			for (int c = 0; c < 32; c += 8) {
+				uint32_t sum = 2;
+				for (uint32_t t : texels)
+					sum += (t >> c) & 0xFF;
+				result |= (sum / 4) << c;
+			}
+			next[y * next_width + x] = result;
+		}
+	}
+
+	return next;
+}
+
+Eigen::Vector4f TextureSampling::unpack(uint32_t rgba)
+{
+	return Eigen::Vector4f(
+	    static_cast<float>(rgba & 0xFF),
+	    static_cast<float>((rgba >> 8) & 0xFF),
+	    static_cast<float>((rgba >> 16) & 0xFF),
+	    static_cast<float>(rgba >> 24)) /
+	    255.0f;
+}
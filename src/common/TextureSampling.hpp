@@ -0,0 +1,104 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <eigen3/Eigen/Eigen>
+
+enum class TextureType {
+	DIFFUSE,
+	SPECULAR,
+	BUMP
+};
+
+enum class TextureFilter {
+	NEAREST,
+	BILINEAR,
+	TRILINEAR
+};
+
+// interleaves the low 16 bits of x and y into a Z-order index
+inline uint32_t morton(uint32_t x, uint32_t y)
+{
+	auto spread = [](uint32_t v) {
+		v = (v | (v << 8)) & 0x00FF00FF;
+		v = (v | (v << 4)) & 0x0F0F0F0F;
+		v = (v | (v << 2)) & 0x33333333;
+		v = (v | (v << 1)) & 0x55555555;
+		return v;
+	};
+
+	return spread(x) | (spread(y) << 1);
+}
+
+// mip chains of RGBA8 texels filtered the same way by the rasterizer's resident textures and the raytracer's tiled
+// ones; a texture provides filter, width, height, levels with their width and height, and fetch(level, x, y)
+namespace TextureSampling
+{
+// decodes an image into row-major RGBA8 with its first row at the bottom, as uv space has it; empty when the file
+// cannot be read. safe to call from the loader pool, the vertical flip is set per thread
+auto decode(const std::string& file_path, int& width, int& height, int& channels) -> std::vector<uint32_t>;
+
+// the next level of a row-major image, each texel the rounded mean of a 2x2 block with odd edges clamped
+auto downsample(const std::vector<uint32_t>& pixels, int width, int height) -> std::vector<uint32_t>;
+auto unpack(uint32_t rgba) -> Eigen::Vector4f;
+
+// coordinates wrap, fetch only sees texels inside the level
+template <typename T>
+Eigen::Vector4f texel(const T& texture, int level, int x, int y)
+{
+	const auto& mip = texture.levels[level];
+	x %= mip.width;
+	y %= mip.height;
+	if (x < 0)
+		x += mip.width;
+	if (y < 0)
+		y += mip.height;
+
+	return unpack(texture.fetch(level, x, y));
+}
+
+template <typename T>
+Eigen::Vector4f bilinear(const T& texture, int level, float u, float v)
+{
+	const auto& mip = texture.levels[level];
+	float       x = u * mip.width - 0.5f;
+	float       y = v * mip.height - 0.5f;
+	int         x0 = static_cast<int>(std::floor(x));
+	int         y0 = static_cast<int>(std::floor(y));
+	float       fx = x - x0;
+	float       fy = y - y0;
+
+	Eigen::Vector4f bottom = (1.f - fx) * texel(texture, level, x0, y0) + fx * texel(texture, level, x0 + 1, y0);
+	Eigen::Vector4f top = (1.f - fx) * texel(texture, level, x0, y0 + 1) + fx * texel(texture, level, x0 + 1, y0 + 1);
+
+	return (1.f - fy) * bottom + fy * top;
+}
+
+// footprint is the uv-space area covered by one pixel or ray, zero samples the base level
+template <typename T>
+Eigen::Vector4f sample(const T& texture, float u, float v, float footprint)
+{
+	switch (texture.filter) {
+	case TextureFilter::NEAREST:
+		return texel(texture, 0, static_cast<int>(std::floor(u * texture.width)), static_cast<int>(std::floor(v * texture.height)));
+	case TextureFilter::BILINEAR:
+		return bilinear(texture, 0, u, v);
+	case TextureFilter::TRILINEAR:
+		break;
+	}
+
+	int   levels = static_cast<int>(texture.levels.size());
+	float lod = footprint > 0.f ? 0.5f * std::log2(footprint * texture.width * texture.height) : 0.f;
+	lod = std::clamp(lod, 0.f, static_cast<float>(levels - 1));
+
+	int   level = static_cast<int>(lod);
+	float t = lod - level;
+	if (t == 0.f || level + 1 >= levels)
+		return bilinear(texture, level, u, v);
+
+	return (1.f - t) * bilinear(texture, level, u, v) + t * bilinear(texture, level + 1, u, v);
+}
+};        // namespace TextureSampling
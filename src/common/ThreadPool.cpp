@@ -0,0 +1,57 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned int num_threads)
+{
+	num_threads = std::max(1u, num_threads);
+	for (unsigned int i = 0; i < num_threads; i++) {
+		workers.emplace_back([this]() {
+			while (true) {
+				std::function<void()> task;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					condition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+					if (stopping && tasks.empty())
+						return;
+					task = std::move(tasks.front());
+					tasks.pop();
+				}
+				task();
+			}
+		});
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	condition.notify_all();
+
+	for (auto& worker : workers)
+		worker.join();
+}
+
+bool ThreadPool::runPending()
+{
+	std::function<void()> task;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (tasks.empty())
+			return false;
+		task = std::move(tasks.front());
+		tasks.pop();
+	}
+	task();
+
+	return true;
+}
+
+ThreadPool& ThreadPool::instance()
+{
+	static ThreadPool pool;
+	return pool;
+}
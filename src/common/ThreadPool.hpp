@@ -0,0 +1,58 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+private:
+	std::vector<std::thread>          workers;
+	std::queue<std::function<void()>> tasks;
+	std::mutex                        mutex;
+	std::condition_variable           condition;
+	bool                              stopping{false};
+
+public:
+	explicit ThreadPool(unsigned int num_threads = std::thread::hardware_concurrency());
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	bool runPending();
+
+	template <typename F, typename... Args>
+	auto submit(F&& func, Args&&... args) -> std::future<std::invoke_result_t<F, Args...>>
+	{
+		using result_t = std::invoke_result_t<F, Args...>;
+
+		auto task = std::make_shared<std::packaged_task<result_t()>>(
+		    std::bind(std::forward<F>(func), std::forward<Args>(args)...));
+		auto future = task->get_future();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			tasks.emplace([task]() { (*task)(); });
+		}
+		condition.notify_one();
+
+		return future;
+	}
+
+	// runs queued tasks while waiting, so tasks may wait on tasks they submitted without starving the pool
+	template <typename T>
+	auto wait(std::future<T>& future) -> T
+	{
+		while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			if (!runPending())
+				future.wait_for(std::chrono::milliseconds(1));
+
+		return future.get();
+	}
+
+	static ThreadPool& instance();
+};
@@ -1,4 +1,3 @@
-#define STB_IMAGE_IMPLEMENTATION
 #define TINYOBJLOADER_IMPLEMENTATION
 
 #include "Model.hpp"
@@ -6,38 +5,7 @@
 #include <cstddef>
 #include <iostream>
 
-Texture::Texture(std::string file_path, TextureType type)
-{
-	this->file_path = file_path;
-	this->type = type;
-	auto image = stbi_load(file_path.c_str(), &this->width, &this->height, &this->nrChannels, 0);
-	stbi_set_flip_vertically_on_load(true);
-
-	if (image == nullptr) {
-		std::cerr << "Failed to load texture " << file_path << std::endl;
-		exit(1);
-	}
-
-	data.resize(this->width * this->height);
-	for (int i = 0; i < this->width * this->height; i++)
-		data[i] = vec3f_t(
-		    image[i * nrChannels + 0] / 255.0f,
-		    image[i * nrChannels + 1] / 255.0f,
-		    image[i * nrChannels + 2] / 255.0f);
-
-	stbi_image_free(image);
-}
-
-vec3f_t Texture::sample(float u, float v) const
-{
-	int u_img = u * width;
-	int v_img = v * height;
-	int index = u_img * width + v_img;
-	if (index < 0)
-		index = 0;
-
-	return data[index % data.size()];
-}
+#include "ThreadPool.hpp"
 
 Model::Model(const std::string& filepath)
 {
@@ -79,16 +47,22 @@ void Model::readTextures(const std::string& filepath)
 	size_t      file_pos = filepath.find_last_of('/');
 	std::string file_dir = filepath.substr(0, file_pos + 1);
 
-	for (auto& material : materials) {
-		if (!material.diffuse_texname.empty())
-			textures[material.diffuse_texname] = new Texture(file_dir + material.diffuse_texname, TextureType::DIFFUSE);
+	auto&                                          pool = ThreadPool::instance();
+	std::map<std::string, std::future<Texture*>> pending_textures;
 
-		if (!material.specular_texname.empty())
-			textures[material.specular_texname] = new Texture(file_dir + material.specular_texname, TextureType::SPECULAR);
+	auto decode = [&](const std::string& name, TextureType type) {
+		if (!name.empty() && !pending_textures.contains(name))
+			pending_textures.emplace(name, pool.submit([path = file_dir + name, type]() { return new Texture(path, type); }));
+	};
 
-		if (!material.bump_texname.empty())
-			textures[material.bump_texname] = new Texture(file_dir + material.bump_texname, TextureType::BUMP);
+	for (auto& material : materials) {
+		decode(material.diffuse_texname, TextureType::DIFFUSE);
+		decode(material.specular_texname, TextureType::SPECULAR);
+		decode(material.bump_texname, TextureType::BUMP);
 	}
+
+	for (auto& [name, texture] : pending_textures)
+		textures[name] = pool.wait(texture);
 }
 
 void Model::setTextures(const std::map<std::string, Texture*>& textures)
@@ -100,9 +74,14 @@ void Model::addTextures(const std::string& filepath, TextureType type)
 {
 	if (filepath.empty())
 		return;
+	addTextures(filepath, new Texture(filepath, type));
+}
+
+void Model::addTextures(const std::string& filepath, Texture* texture)
+{
 	size_t      file_pos = filepath.find_last_of('/');
 	std::string file_name = filepath.substr(file_pos + 1);
-	textures[file_name] = new Texture(filepath, type);
+	textures[file_name] = texture;
 }
 
 auto Model::getBoundingBox() -> std::pair<vec2f_t, vec2f_t>
@@ -1,31 +1,13 @@
 #pragma once
 
 #include "global.hpp"
+#include "Texture.hpp"
 
 #include <string>
 #include <vector>
 #include <tiny_obj_loader.h>
 #include <stb_image.h>
 
-enum class TextureType {
-	DIFFUSE,
-	SPECULAR,
-	BUMP
-};
-
-struct Texture {
-	int width;
-	int height;
-	int nrChannels;
-
-	std::string          file_path;
-	std::vector<vec3f_t> data;
-	TextureType          type;
-
-	Texture(std::string file_path, TextureType type);
-	vec3f_t sample(float u, float v) const;
-};
-
 class Model {
 private:
 	tinyobj::attrib_t                attrib;
@@ -42,6 +24,7 @@ public:
 
 	void setTextures(const std::map<std::string, Texture*>& textures);
 	void addTextures(const std::string& filepath, TextureType type);
+	void addTextures(const std::string& filepath, Texture* texture);
 	auto getBoundingBox() -> std::pair<vec2f_t, vec2f_t>;
 	auto getBoundingBoxCenter() -> vec2f_t;
 	auto getBoundingBoxSize() -> vec2f_t;
@@ -1,5 +1,10 @@
 #include "Pipeline.hpp"
 
+#include <filesystem>
+#include <iostream>
+
+#include "ThreadPool.hpp"
+
 Pipeline Pipeline::instance;
 
 Pipeline::Pipeline()
@@ -7,12 +12,24 @@ Pipeline::Pipeline()
 	model_path = PROJECT_PATH "/assets/Diablo/diablo3_pose.obj";
 	texture_path = PROJECT_PATH "/assets/Diablo/diablo3_pose_diffuse.tga";
 
-	model = new Model(model_path);
-	model->addTextures(texture_path, TextureType::DIFFUSE);
+	// a copy baked by the raytracer's --bake carries global illumination in its vertex colors
+	std::string baked_path = PROJECT_PATH "/assets/Diablo/diablo3_pose_baked.obj";
+	if (std::filesystem::exists(baked_path))
+		model_path = baked_path;
+
+	// the mesh and its texture load concurrently while the rest of the pipeline is set up
+	auto& pool = ThreadPool::instance();
+	auto  model_loading = pool.submit([this]() { return new Model(model_path); });
+	auto  texture_loading = pool.submit([this]() { return new Texture(texture_path, TextureType::DIFFUSE); });
 
 	camera = new Camera(vec3f_t{width / 2.f, height / 2.f, 3.0f});
 	rasterizer = new Rasterizer(width, height);
 	shader = new Shader();
+
+	model = pool.wait(model_loading);
+	model->addTextures(texture_path, pool.wait(texture_loading));
+
+	PerfCounters::enabled = PerfCounters::local().available();
 }
 
 Pipeline::~Pipeline()
@@ -56,5 +73,20 @@ void Pipeline::render()
 	instance.shader->setViewPos(instance.camera->getPosition());
 	instance.shader->flush();
 	instance.shader->transform();
-	instance.shader->render();
+	{
+		PerfScope counters(instance.raster_counters);
+		instance.shader->render();
+	}
+
+	if (PerfCounters::enabled && ++instance.counted_frames == COUNTER_FRAMES) {
+		const PerfSample& sample = instance.raster_counters;
+		double            pixels = static_cast<double>(instance.width) * instance.height * COUNTER_FRAMES;
+		std::cout << "Rasterization: IPC " << sample.ipc() << ", per pixel "
+		          << sample.l1_misses / pixels << " L1 misses, "
+		          << sample.llc_misses / pixels << " LLC misses, "
+		          << sample.branch_misses / pixels << " branch misses" << std::endl;
+
+		instance.raster_counters = PerfSample{};
+		instance.counted_frames = 0;
+	}
 }
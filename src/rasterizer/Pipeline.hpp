@@ -4,6 +4,7 @@
 
 #include "Camera.hpp"
 #include "Model.hpp"
+#include "PerfCounters.hpp"
 #include "Rasterizer.hpp"
 #include "Shader.hpp"
 
@@ -21,6 +22,12 @@ private:
 
 	std::array<std::vector<std::function<void()>>, 3> callback_queue;
 
+	// hardware counts of rasterization and fragment shading, reported every COUNTER_FRAMES frames
+	static constexpr int COUNTER_FRAMES = 100;
+
+	PerfSample raster_counters;
+	int        counted_frames{0};
+
 	Pipeline();
 	~Pipeline();
 
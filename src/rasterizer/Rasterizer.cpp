@@ -102,6 +102,11 @@ void Rasterizer::drawTriangle(const triangle_t& triangle, ShaderInfo& shader_inf
 	const auto& t = triangle.texcoords;
 	const auto& c = triangle.colors;
 
+	// uv-space area covered by one pixel, used to pick the mip level
+	float screen_area = std::abs((v[1].x() - v[0].x()) * (v[2].y() - v[0].y()) - (v[2].x() - v[0].x()) * (v[1].y() - v[0].y()));
+	float uv_area = std::abs((t[1].x() - t[0].x()) * (t[2].y() - t[0].y()) - (t[2].x() - t[0].x()) * (t[1].y() - t[0].y()));
+	shader_info.footprint = screen_area > 0.f ? uv_area / screen_area : 0.f;
+
 	int min_x = std::min({triangle.vertices[0].x(), triangle.vertices[1].x(), triangle.vertices[2].x()});
 	int min_y = std::min({triangle.vertices[0].y(), triangle.vertices[1].y(), triangle.vertices[2].y()});
 	int max_x = std::max({triangle.vertices[0].x(), triangle.vertices[1].x(), triangle.vertices[2].x()}) + 1;
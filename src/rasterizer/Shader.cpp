@@ -207,11 +207,13 @@ vec3f_t Shader::textureShader(const ShaderInfo& shader)
 {
 	vec3f_t texture_color = vec3f_t::Identity();
 	if (!shader.textures.empty()) {
-		texture_color = shader.textures[0]->sample(shader.texcoord.x(), shader.texcoord.y());
+		texture_color = shader.textures[0]->sample(shader.texcoord.x(), shader.texcoord.y(), shader.footprint);
 		for (auto& texture : shader.textures)
 			if (texture->type == TextureType::DIFFUSE)
-				texture_color = texture->sample(shader.texcoord.x(), shader.texcoord.y());
-		return texture_color;
+				texture_color = texture->sample(shader.texcoord.x(), shader.texcoord.y(), shader.footprint);
+
+		// vertex colors carry lighting baked by the raytracer, tinyobj fills them with white when a model has none
+		return texture_color.cwiseProduct(shader.color);
 	}
 
 	light_t light({960, 540, 20}, {500, 500, 500});
@@ -8,6 +8,7 @@ struct ShaderInfo {
 	vec3f_t color;
 	vec3f_t normal;
 	vec2f_t texcoord;
+	float   footprint{0.f};
 
 	vec3f_t ambient;
 	vec3f_t diffuse;
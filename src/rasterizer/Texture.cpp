@@ -0,0 +1,61 @@
+#include "Texture.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+MipLevel::MipLevel(int width, int height) :
+    width(width),
+    height(height),
+    tiles_x((width + TILE_SIZE - 1) / TILE_SIZE),
+    tiles_y((height + TILE_SIZE - 1) / TILE_SIZE),
+    texels(static_cast<size_t>(tiles_x) * tiles_y * TILE_SIZE * TILE_SIZE, 0)
+{}
+
+Texture::Texture(const std::string& file_path, TextureType type)
+{
+	this->file_path = file_path;
+	this->type = type;
+	std::vector<uint32_t> pixels = TextureSampling::decode(file_path, this->width, this->height, this->nrChannels);
+	if (pixels.empty()) {
+		std::cerr << "Failed to load texture " << file_path << std::endl;
+		exit(1);
+	}
+
+	// build the mip chain from the row-major image, then scatter every level into its tiled layout
+	int level_width = width;
+	int level_height = height;
+
+	while (true) {
+		MipLevel& level = levels.emplace_back(level_width, level_height);
+		for (int y = 0; y < level_height; y++)
+			for (int x = 0; x < level_width; x++)
+				level.texels[level.index(x, y)] = pixels[y * level_width + x];
+
+		if (level_width == 1 && level_height == 1)
+			break;
+
+		pixels = TextureSampling::downsample(pixels, level_width, level_height);
+		level_width = std::max(1, level_width / 2);
+		level_height = std::max(1, level_height / 2);
+	}
+}
+
+vec3f_t Texture::sample(float u, float v, float footprint) const
+{
+	return sampleRGBA(u, v, footprint).head<3>();
+}
+
+vec4f_t Texture::sampleRGBA(float u, float v, float footprint) const
+{
+	return TextureSampling::sample(*this, u, v, footprint);
+}
+
+size_t Texture::memoryUsage() const
+{
+	size_t bytes = 0;
+	for (const auto& level : levels)
+		bytes += level.texels.size() * sizeof(uint32_t);
+
+	return bytes;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "global.hpp"
+#include "TextureSampling.hpp"
+
+// one mip level of RGBA8 texels, stored as TILE_SIZE x TILE_SIZE tiles with Morton order inside each tile
+struct MipLevel {
+	static constexpr int TILE_SIZE = 32;
+
+	int width;
+	int height;
+	int tiles_x;
+	int tiles_y;
+
+	std::vector<uint32_t> texels;
+
+	MipLevel(int width, int height);
+
+	size_t index(int x, int y) const
+	{
+		size_t tile = static_cast<size_t>(y / TILE_SIZE) * tiles_x + x / TILE_SIZE;
+		return tile * TILE_SIZE * TILE_SIZE + morton(x % TILE_SIZE, y % TILE_SIZE);
+	}
+
+	uint32_t fetch(int x, int y) const { return texels[index(x, y)]; }
+};
+
+struct Texture {
+	int width;
+	int height;
+	int nrChannels;
+
+	std::string           file_path;
+	TextureType           type;
+	TextureFilter         filter{TextureFilter::TRILINEAR};
+	std::vector<MipLevel> levels;
+
+	Texture(const std::string& file_path, TextureType type);
+
+	// footprint is the uv-space area covered by one pixel or ray, zero samples the base level
+	vec3f_t sample(float u, float v, float footprint = 0.f) const;
+	vec4f_t sampleRGBA(float u, float v, float footprint = 0.f) const;
+
+	auto fetch(int level, int x, int y) const -> uint32_t { return levels[level].fetch(x, y); }
+	auto memoryUsage() const -> size_t;
+};
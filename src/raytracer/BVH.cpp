@@ -1,15 +1,223 @@
 #include "BVH.hpp"
 
-BVHAccel::BVHAccel(std::vector<Primitive*> primitives,
-                   int                     max_primitives_per_leaf,
-                   BVHBuildMethod          build_method) :
-    MAX_PRIMITIVES_PER_LEAF(max_primitives_per_leaf),
-    BUILD_METHOD(build_method)
+#include <algorithm>
+#include <bit>
+#include <iostream>
+#include <numeric>
+
+#include "ThreadPool.hpp"
+#include "Timeline.hpp"
+
+namespace
+{
+constexpr int   OBJECT_BINS = 16;
+constexpr int   SPATIAL_BINS = 16;
+constexpr float SPATIAL_ALPHA = 1e-5f;
+constexpr int   PARALLEL_DEPTH = 4;
+
+bool valid(const Bound& bound)
+{
+	return (bound.pmin.array() <= bound.pmax.array()).all();
+}
+
+float surface(const Bound& bound)
+{
+	return valid(bound) ? static_cast<float>(bound.area()) : 0.f;
+}
+
+struct Split {
+	int   axis{-1};
+	int   bin{};
+	float cost{std::numeric_limits<float>::max()};
+	Bound left{};
+	Bound right{};
+};
+
+// binned SAH over the centroids of count bounds, bound_of(i) yields the i-th bound
+template <typename F>
+Split findObjectSplit(size_t count, F&& bound_of, const Bound& centroid_bound)
+{
+	Split best;
+
+	for (int axis = 0; axis < 3; axis++) {
+		float min = centroid_bound.pmin[axis];
+		float extent = centroid_bound.pmax[axis] - min;
+		if (!(extent > 0.f))
+			continue;
+
+		std::array<Bound, OBJECT_BINS> bins{};
+		std::array<int, OBJECT_BINS>   counts{};
+		for (size_t i = 0; i < count; i++) {
+			Bound bound = bound_of(i);
+			int   bin = std::min(static_cast<int>(OBJECT_BINS * (bound.centroid()[axis] - min) / extent), OBJECT_BINS - 1);
+			bins[bin] = Bound::merge(bins[bin], bound);
+			counts[bin]++;
+		}
+
+		// sweep from the right to get suffix areas, then from the left to evaluate every plane
+		std::array<Bound, OBJECT_BINS> right_bounds{};
+		std::array<int, OBJECT_BINS>   right_counts{};
+		Bound                          right{};
+		int                            right_count = 0;
+		for (int b = OBJECT_BINS - 1; b > 0; b--) {
+			right = Bound::merge(right, bins[b]);
+			right_count += counts[b];
+			right_bounds[b] = right;
+			right_counts[b] = right_count;
+		}
+
+		Bound left{};
+		int   left_count = 0;
+		for (int b = 0; b < OBJECT_BINS - 1; b++) {
+			left = Bound::merge(left, bins[b]);
+			left_count += counts[b];
+			if (left_count == 0 || right_counts[b + 1] == 0)
+				continue;
+
+			float cost = surface(left) * left_count + surface(right_bounds[b + 1]) * right_counts[b + 1];
+			if (cost < best.cost)
+				best = Split{axis, b, cost, left, right_bounds[b + 1]};
+		}
+	}
+
+	return best;
+}
+
+bool isLeaf(const BVHNode* node)
 {
-	if (primitives.empty())
+	return !node->left || !node->right;
+}
+
+double sah(const BVHNode* node)
+{
+	if (isLeaf(node))
+		return BVHAccel::INTERSECTION_COST * node->num_primitives * surface(node->bound);
+
+	return BVHAccel::TRAVERSAL_COST * surface(node->bound) + sah(node->left) + sah(node->right);
+}
+
+double compressedSah(const std::vector<CompressedBVHNode>& nodes, uint32_t index)
+{
+	const auto& node = nodes[index];
+	int         children = node.flags & CompressedBVHNode::EMPTY_CHILD ? 1 : 2;
+
+	double cost = 0.0;
+	for (int k = 0; k < children; k++) {
+		float area = surface(node.childBound(k));
+		if (node.count[k] > 0)
+			cost += BVHAccel::INTERSECTION_COST * node.count[k] * area;
+		else
+			cost += BVHAccel::TRAVERSAL_COST * area + compressedSah(nodes, node.child[k]);
+	}
+
+	return cost;
+}
+
+// picks per axis the smallest power-of-two step that spans the box in 255 steps
+void setBox(CompressedBVHNode& node, const Bound& box)
+{
+	for (int axis = 0; axis < 3; axis++) {
+		float extent = box.pmax[axis] - box.pmin[axis];
+		int   exponent = extent > 0.f ? static_cast<int>(std::ceil(std::log2(extent / 255.f))) : -126;
+		exponent = std::clamp(exponent, -126, 127);
+
+		node.origin[axis] = box.pmin[axis];
+		node.exponent[axis] = static_cast<int8_t>(exponent);
+		while (node.exponent[axis] < 127 && node.origin[axis] + 255 * node.scale(axis) < box.pmax[axis])
+			node.exponent[axis]++;
+	}
+}
+
+// rounds the child box outwards so decoding never shrinks it
+void quantize(CompressedBVHNode& node, int k, const Bound& child)
+{
+	for (int axis = 0; axis < 3; axis++) {
+		float origin = node.origin[axis];
+		float scale = node.scale(axis);
+
+		int lo = std::clamp(static_cast<int>(std::floor((child.pmin[axis] - origin) / scale)), 0, 255);
+		while (lo > 0 && origin + lo * scale > child.pmin[axis])
+			lo--;
+
+		int hi = std::clamp(static_cast<int>(std::ceil((child.pmax[axis] - origin) / scale)), 0, 255);
+		while (hi < 255 && origin + hi * scale < child.pmax[axis])
+			hi++;
+
+		node.qmin[k][axis] = static_cast<uint8_t>(lo);
+		node.qmax[k][axis] = static_cast<uint8_t>(hi);
+	}
+}
+
+int objectBin(const Split& split, const Bound& centroid_bound, const vec3f_t& centroid)
+{
+	float min = centroid_bound.pmin[split.axis];
+	float extent = centroid_bound.pmax[split.axis] - min;
+
+	return std::min(static_cast<int>(OBJECT_BINS * (centroid[split.axis] - min) / extent), OBJECT_BINS - 1);
+}
+};        // namespace
+
+BVHAccel::BVHAccel(std::vector<Bound>        primitive_bounds,
+                   const std::vector<float>& primitive_areas,
+                   const BVHBuildOptions&    options) :
+    areas(primitive_areas),
+    bounds(std::move(primitive_bounds)),
+    MAX_PRIMITIVES_PER_LEAF(std::max(options.max_primitives_per_leaf, 1)),
+    BUILD_METHOD(options.method),
+    LAZY(options.lazy),
+    DUPLICATION_BUDGET(std::max(options.duplication_budget, 0.f)),
+    clip(options.clip)
+{
+	TraceScope scope("bvh build", "bvh", std::to_string(bounds.size()) + " primitives");
+
+	if (bounds.empty())
+		return;
+
+	if (!clip)
+		clip = [this](uint32_t id, const Bound& box) { return bounds[id].intersect(box); };
+
+	// spatial splits grow the reference lists, lazy builds keep splitting ranges in place with object splits
+	if (BUILD_METHOD == BVHBuildMethod::SBVH && !LAZY) {
+		std::vector<BVHReference> references(bounds.size());
+		Bound                     total{};
+		for (size_t i = 0; i < bounds.size(); i++) {
+			references[i] = BVHReference{static_cast<uint32_t>(i), bounds[i]};
+			total = Bound::merge(total, bounds[i]);
+		}
+
+		size_t            budget = static_cast<size_t>(DUPLICATION_BUDGET * bounds.size());
+		std::vector<bool> owned(bounds.size(), false);
+		indices.reserve(bounds.size() + budget);
+		weights.reserve(bounds.size() + budget);
+
+		root = buildSpatial(references, 0, surface(total), budget, owned);
+		root_bound = root->bound;
+		bounds = {};
+		optimize(options.optimize_passes);
+		if (options.compress)
+			compress();
 		return;
+	}
+
+	centroids.resize(bounds.size());
+	for (size_t i = 0; i < bounds.size(); i++)
+		centroids[i] = bounds[i].centroid();
+
+	indices.resize(bounds.size());
+	std::iota(indices.begin(), indices.end(), 0u);
+	weights.resize(bounds.size());
 
-	root = build(primitives);
+	root = build(0, static_cast<int>(indices.size()), LAZY ? LAZY_LEVELS : std::numeric_limits<int>::max(), 0);
+	root_bound = root->bound;
+
+	// pending subtrees still need the per-primitive build inputs, and would be built over unoptimized anyway
+	if (!LAZY) {
+		bounds = {};
+		centroids = {};
+		optimize(options.optimize_passes);
+		if (options.compress)
+			compress();
+	}
 }
 
 BVHAccel::~BVHAccel()
@@ -17,68 +225,247 @@ BVHAccel::~BVHAccel()
 	destroy(root);
 }
 
-BVHNode* BVHAccel::build(std::vector<Primitive*> primitives)
+BVHNode* BVHAccel::build(int begin, int end, int levels, int depth) const
 {
 	auto* node = new BVHNode();
 
-	Bound total_bound{};
-	for (const auto* p : primitives)
-		total_bound = Bound::merge(total_bound, p->bound());
+	node->first_offset = begin;
+	node->num_primitives = end - begin;
+	for (int i = begin; i < end; i++) {
+		node->bound = Bound::merge(node->bound, bounds[indices[i]]);
+		node->area += areas[indices[i]];
+	}
 
-	if (primitives.size() == 1) {
-		node->bound = primitives.front()->bound();
-		node->primitive = primitives.front();
-		node->left = nullptr;
-		node->right = nullptr;
-		node->area = primitives.front()->area();
+	if (end - begin <= MAX_PRIMITIVES_PER_LEAF || depth >= MAX_DEPTH) {
+		for (int i = begin; i < end; i++)
+			weights[i] = areas[indices[i]];
 		return node;
-	} else if (primitives.size() == 2) {
-		node->left = build({primitives[0]});
-		node->right = build({primitives[1]});
-		node->bound = Bound::merge(node->left->bound, node->right->bound);
-		node->area = node->left->area + node->right->area;
+	}
+
+	if (levels == 0) {
+		node->depth = depth;
+		node->pending.store(true, std::memory_order_relaxed);
 		return node;
-	} else {
-		Bound centroid_bound{};
-		for (auto* p : primitives)
-			centroid_bound = Bound::merge(centroid_bound, p->bound().centroid());
-
-		switch (int dim = centroid_bound.maxextent(); dim) {
-		case 0:
-			std::sort(primitives.begin(), primitives.end(), [](auto* a, auto* b) {
-				return a->bound().centroid().x() < b->bound().centroid().x();
-			});
-			break;
-		case 1:
-			std::sort(primitives.begin(), primitives.end(), [](auto* a, auto* b) {
-				return a->bound().centroid().y() < b->bound().centroid().y();
-			});
-			break;
-		case 2:
-			std::sort(primitives.begin(), primitives.end(), [](auto* a, auto* b) {
-				return a->bound().centroid().z() < b->bound().centroid().z();
+	}
+
+	Bound centroid_bound{centroids[indices[begin]], centroids[indices[begin]]};
+	for (int i = begin; i < end; i++)
+		centroid_bound = Bound::merge(centroid_bound, centroids[indices[i]]);
+
+	int dim = centroid_bound.maxextent();
+	int mid = begin + (end - begin) / 2;
+
+	if (BUILD_METHOD != BVHBuildMethod::NAIVE) {
+		Split split = findObjectSplit(end - begin, [&](size_t i) { return bounds[indices[begin + i]]; }, centroid_bound);
+		if (split.axis >= 0) {
+			dim = split.axis;
+			auto middle = std::partition(indices.begin() + begin, indices.begin() + end, [&](uint32_t id) {
+				return objectBin(split, centroid_bound, centroids[id]) <= split.bin;
 			});
-			break;
+			mid = static_cast<int>(middle - indices.begin());
 		}
+	}
 
-		auto beg = primitives.begin();
-		auto mid = primitives.begin() + primitives.size() / 2;
-		auto end = primitives.end();
-		auto left_primitives = std::vector<Primitive*>(beg, mid);
-		auto right_primitives = std::vector<Primitive*>(mid, end);
+	// the median split also covers primitives whose centroids coincide
+	if (BUILD_METHOD == BVHBuildMethod::NAIVE || mid == begin || mid == end) {
+		mid = begin + (end - begin) / 2;
+		std::nth_element(indices.begin() + begin, indices.begin() + mid, indices.begin() + end, [&](uint32_t a, uint32_t b) {
+			return centroids[a][dim] < centroids[b][dim];
+		});
+	}
 
-		assert(primitives.size() == (left_primitives.size() + right_primitives.size()));
+	node->split_axis = dim;
+	node->left = build(begin, mid, levels - 1, depth + 1);
+	node->right = build(mid, end, levels - 1, depth + 1);
 
-		node->left = build(left_primitives);
-		node->right = build(right_primitives);
+	return node;
+}
 
-		node->bound = Bound::merge(node->left->bound, node->right->bound);
-		node->area = node->left->area + node->right->area;
+BVHNode* BVHAccel::buildSpatial(std::vector<BVHReference>& references, int depth, float root_area, size_t& budget, std::vector<bool>& owned)
+{
+	auto* node = new BVHNode();
+
+	Bound centroid_bound{};
+	for (const auto& reference : references) {
+		node->bound = Bound::merge(node->bound, reference.bound);
+		centroid_bound = Bound::merge(centroid_bound, reference.bound.centroid());
 	}
 
+	if (static_cast<int>(references.size()) <= MAX_PRIMITIVES_PER_LEAF || depth >= MAX_DEPTH) {
+		node->first_offset = static_cast<int>(indices.size());
+		node->num_primitives = static_cast<int>(references.size());
+		for (const auto& reference : references) {
+			// a duplicated primitive is sampled through the first leaf that holds it
+			float weight = owned[reference.id] ? 0.f : areas[reference.id];
+			owned[reference.id] = true;
+			indices.push_back(reference.id);
+			weights.push_back(weight);
+			node->area += weight;
+		}
+		return node;
+	}
+
+	Split object = findObjectSplit(references.size(), [&](size_t i) { return references[i].bound; }, centroid_bound);
+
+	// spatial splits only pay off where the object split children overlap noticeably
+	Split spatial;
+	if (budget > 0 && object.axis >= 0 && surface(object.left.intersect(object.right)) > SPATIAL_ALPHA * root_area) {
+		for (int axis = 0; axis < 3; axis++) {
+			float min = node->bound.pmin[axis];
+			float extent = node->bound.pmax[axis] - min;
+			if (!(extent > 0.f))
+				continue;
+
+			auto binOf = [&](float x) {
+				return std::clamp(static_cast<int>(SPATIAL_BINS * (x - min) / extent), 0, SPATIAL_BINS - 1);
+			};
+
+			std::array<Bound, SPATIAL_BINS> bins{};
+			std::array<int, SPATIAL_BINS>   entries{};
+			std::array<int, SPATIAL_BINS>   exits{};
+			for (const auto& reference : references) {
+				int first = binOf(reference.bound.pmin[axis]);
+				int last = binOf(reference.bound.pmax[axis]);
+				entries[first]++;
+				exits[last]++;
+
+				for (int b = first; b <= last; b++) {
+					Bound slab = node->bound;
+					slab.pmin[axis] = min + extent * b / SPATIAL_BINS;
+					slab.pmax[axis] = b == SPATIAL_BINS - 1 ? node->bound.pmax[axis] : min + extent * (b + 1) / SPATIAL_BINS;
+
+					Bound clipped = first == last ? reference.bound : clip(reference.id, reference.bound.intersect(slab));
+					if (valid(clipped))
+						bins[b] = Bound::merge(bins[b], clipped);
+				}
+			}
+
+			std::array<Bound, SPATIAL_BINS> right_bounds{};
+			std::array<int, SPATIAL_BINS>   right_counts{};
+			Bound                           right{};
+			int                             right_count = 0;
+			for (int b = SPATIAL_BINS - 1; b > 0; b--) {
+				right = Bound::merge(right, bins[b]);
+				right_count += exits[b];
+				right_bounds[b] = right;
+				right_counts[b] = right_count;
+			}
+
+			Bound left{};
+			int   left_count = 0;
+			for (int b = 0; b < SPATIAL_BINS - 1; b++) {
+				left = Bound::merge(left, bins[b]);
+				left_count += entries[b];
+				if (left_count == 0 || right_counts[b + 1] == 0)
+					continue;
+
+				float cost = surface(left) * left_count + surface(right_bounds[b + 1]) * right_counts[b + 1];
+				if (cost < spatial.cost)
+					spatial = Split{axis, b, cost, left, right_bounds[b + 1]};
+			}
+		}
+	}
+
+	std::vector<BVHReference> left, right;
+
+	if (spatial.axis >= 0 && spatial.cost < object.cost) {
+		int   axis = spatial.axis;
+		float position = node->bound.pmin[axis] + (node->bound.pmax[axis] - node->bound.pmin[axis]) * (spatial.bin + 1) / SPATIAL_BINS;
+
+		Bound left_box = node->bound, right_box = node->bound;
+		left_box.pmax[axis] = position;
+		right_box.pmin[axis] = position;
+
+		Bound left_bound{}, right_bound{};
+		for (const auto& reference : references) {
+			if (reference.bound.pmax[axis] <= position) {
+				left.push_back(reference);
+				left_bound = Bound::merge(left_bound, reference.bound);
+			} else if (reference.bound.pmin[axis] >= position) {
+				right.push_back(reference);
+				right_bound = Bound::merge(right_bound, reference.bound);
+			}
+		}
+
+		for (const auto& reference : references) {
+			if (reference.bound.pmax[axis] <= position || reference.bound.pmin[axis] >= position)
+				continue;
+
+			Bound clipped_left = clip(reference.id, reference.bound.intersect(left_box));
+			Bound clipped_right = clip(reference.id, reference.bound.intersect(right_box));
+			if (!valid(clipped_left) || !valid(clipped_right)) {
+				auto& side = valid(clipped_left) ? left : right;
+				auto& bound = valid(clipped_left) ? left_bound : right_bound;
+				side.push_back(reference);
+				bound = Bound::merge(bound, reference.bound);
+				continue;
+			}
+
+			// unsplit the reference when keeping it whole on one side is cheaper than duplicating it
+			auto  n_left = static_cast<float>(left.size()), n_right = static_cast<float>(right.size());
+			float split_cost = surface(Bound::merge(left_bound, clipped_left)) * (n_left + 1) + surface(Bound::merge(right_bound, clipped_right)) * (n_right + 1);
+			float left_cost = surface(Bound::merge(left_bound, reference.bound)) * (n_left + 1) + surface(right_bound) * n_right;
+			float right_cost = surface(left_bound) * n_left + surface(Bound::merge(right_bound, reference.bound)) * (n_right + 1);
+
+			if (budget > 0 && split_cost < left_cost && split_cost < right_cost) {
+				left.push_back({reference.id, clipped_left});
+				right.push_back({reference.id, clipped_right});
+				left_bound = Bound::merge(left_bound, clipped_left);
+				right_bound = Bound::merge(right_bound, clipped_right);
+				budget--;
+			} else if (left_cost <= right_cost) {
+				left.push_back(reference);
+				left_bound = Bound::merge(left_bound, reference.bound);
+			} else {
+				right.push_back(reference);
+				right_bound = Bound::merge(right_bound, reference.bound);
+			}
+		}
+
+		node->split_axis = axis;
+	}
+
+	if (left.empty() || right.empty()) {
+		left.clear();
+		right.clear();
+
+		if (object.axis >= 0) {
+			for (const auto& reference : references)
+				(objectBin(object, centroid_bound, reference.bound.centroid()) <= object.bin ? left : right).push_back(reference);
+			node->split_axis = object.axis;
+		} else {
+			// coincident centroids, any even split will do
+			left.assign(references.begin(), references.begin() + references.size() / 2);
+			right.assign(references.begin() + references.size() / 2, references.end());
+			node->split_axis = centroid_bound.maxextent();
+		}
+	}
+
+	references = {};
+	node->left = buildSpatial(left, depth + 1, root_area, budget, owned);
+	node->right = buildSpatial(right, depth + 1, root_area, budget, owned);
+	node->area = node->left->area + node->right->area;
+
 	return node;
 }
 
+void BVHAccel::expand(BVHNode* node) const
+{
+	std::lock_guard lock(expand_mutex);
+	if (!node->pending.load(std::memory_order_relaxed))
+		return;
+
+	// build into a detached node, then publish its children before clearing the flag
+	BVHNode* built = build(node->first_offset, node->first_offset + node->num_primitives, LAZY_LEVELS, node->depth);
+	node->split_axis = built->split_axis;
+	node->left = built->left;
+	node->right = built->right;
+	node->pending.store(false, std::memory_order_release);
+
+	built->left = built->right = nullptr;
+	delete built;
+}
+
 void BVHAccel::destroy(BVHNode* node)
 {
 	if (!node)
@@ -92,48 +479,259 @@ void BVHAccel::destroy(BVHNode* node)
 	delete node;
 }
 
-Intersection BVHAccel::intersect(const Ray& ray) const
+float BVHAccel::cost() const
 {
+	float area = surface(root_bound);
+	if (!(area > 0.f))
+		return 0.f;
+
+	if (!nodes.empty())
+		return static_cast<float>((TRAVERSAL_COST * area + compressedSah(nodes, 0)) / area);
 	if (!root)
-		return Intersection{};
+		return 0.f;
 
-	return getIntersection(root, ray);
+	return static_cast<float>(sah(root) / area);
 }
 
-Intersection BVHAccel::getIntersection(BVHNode* node, const Ray& ray) const
+void BVHAccel::optimize(int passes)
 {
-	Intersection intersection;
+	if (!root || passes <= 0)
+		return;
+
+	float before = cost();
+	for (int pass = 0; pass < passes; pass++)
+		restructure(root, 0);
+	BVHOptimizeTotals::instance().add(areas.size(), before, cost());
+}
 
-	vec3f_t inv_dir = ray.direction.cwiseInverse();
-	if (!node || !node->bound.intersectp(ray, inv_dir, {0, 0, 0}))
-		return intersection;
+void BVHOptimizeTotals::add(size_t num_primitives, float cost_before, float cost_after)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	trees++;
+	primitives += num_primitives;
+	before += cost_before;
+	after += cost_after;
+}
 
-	if (!node->left && !node->right)
-		return node->primitive->getIntersection(ray);
+void BVHOptimizeTotals::report()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (trees == 0)
+		return;
+
+	// costs are relative to each root's surface, so trees of different sizes are averaged rather than summed
+	std::cout << "Optimized " << trees << " BVHs over " << primitives << " primitives, mean SAH cost "
+	          << before / trees << " -> " << after / trees << std::endl;
+}
+
+BVHOptimizeTotals& BVHOptimizeTotals::instance()
+{
+	static BVHOptimizeTotals totals;
+	return totals;
+}
+
+void BVHAccel::restructure(BVHNode* node, int depth)
+{
+	// pending nodes count as leaves, their subtrees do not exist yet
+	if (isLeaf(node)) {
+		node->cost = INTERSECTION_COST * node->num_primitives * surface(node->bound);
+		node->height = 0;
+		return;
+	}
 
-	Intersection hit1 = getIntersection(node->left, ray);
-	Intersection hit2 = getIntersection(node->right, ray);
+	// treelets only touch nodes below their root, so sibling subtrees are independent
+	if (depth < PARALLEL_DEPTH) {
+		auto& pool = ThreadPool::instance();
+		auto  left = pool.submit([this, node, depth]() { restructure(node->left, depth + 1); });
+		restructure(node->right, depth + 1);
+		pool.wait(left);
+	} else {
+		restructure(node->left, depth + 1);
+		restructure(node->right, depth + 1);
+	}
 
-	return hit1.distance < hit2.distance ? hit1 : hit2;
+	node->cost = TRAVERSAL_COST * surface(node->bound) + node->left->cost + node->right->cost;
+	node->height = 1 + std::max(node->left->height, node->right->height);
+	restructureTreelet(node, depth);
 }
 
-void BVHAccel::sample(Intersection& pos, float& pdf) const
+void BVHAccel::restructureTreelet(BVHNode* root, int depth)
 {
-	float p = Geometry::randomFloat() * root->area;
-	getSample(root, p, pos, pdf);
-	pdf /= root->area;
+	// grow the treelet by repeatedly opening its largest internal leaf
+	std::array<BVHNode*, TREELET_SIZE>     leaves{root->left, root->right};
+	std::array<BVHNode*, TREELET_SIZE - 1> internals{root};
+	int                                    count = 2, internal_count = 1;
+
+	while (count < TREELET_SIZE) {
+		int   largest = -1;
+		float largest_area = -1.f;
+		for (int i = 0; i < count; i++) {
+			if (!isLeaf(leaves[i]) && surface(leaves[i]->bound) > largest_area) {
+				largest = i;
+				largest_area = surface(leaves[i]->bound);
+			}
+		}
+		if (largest < 0)
+			break;
+
+		BVHNode* opened = leaves[largest];
+		internals[internal_count++] = opened;
+		leaves[largest] = opened->left;
+		leaves[count++] = opened->right;
+	}
+
+	if (count < 3)
+		return;
+
+	// optimal topology over every subset of treelet leaves, subsets precede their supersets numerically
+	constexpr int                SUBSETS = 1 << TREELET_SIZE;
+	std::array<Bound, SUBSETS>   subset_bounds{};
+	std::array<float, SUBSETS>   costs{};
+	std::array<uint8_t, SUBSETS> partitions{};
+	std::array<int, SUBSETS>     heights{};
+	int                          full = (1 << count) - 1;
+
+	for (int s = 1; s <= full; s++) {
+		int lowest = std::countr_zero(static_cast<unsigned>(s));
+		subset_bounds[s] = Bound::merge(subset_bounds[s & (s - 1)], leaves[lowest]->bound);
+
+		if ((s & (s - 1)) == 0) {
+			costs[s] = leaves[lowest]->cost;
+			heights[s] = leaves[lowest]->height;
+			continue;
+		}
+
+		float best = std::numeric_limits<float>::max();
+		int   low_bit = s & -s;
+		for (int p = (s - 1) & s; p; p = (p - 1) & s) {
+			if (!(p & low_bit))
+				continue;
+			if (costs[p] + costs[s ^ p] < best) {
+				best = costs[p] + costs[s ^ p];
+				partitions[s] = static_cast<uint8_t>(p);
+			}
+		}
+		costs[s] = TRAVERSAL_COST * surface(subset_bounds[s]) + best;
+		heights[s] = 1 + std::max(heights[partitions[s]], heights[s ^ partitions[s]]);
+	}
+
+	// a topology that would push a leaf past MAX_DEPTH is rejected, traversal stacks are sized by it
+	if (!(costs[full] < root->cost * (1.f - 1e-5f)) || depth + heights[full] > MAX_DEPTH)
+		return;
+
+	// rewire the treelet's internal nodes into the optimal topology
+	int  next = 1;
+	auto assign = [&](auto& self, int s, BVHNode* node) -> void {
+		auto child = [&](int subset) {
+			if ((subset & (subset - 1)) == 0)
+				return leaves[std::countr_zero(static_cast<unsigned>(subset))];
+
+			BVHNode* internal = internals[next++];
+			self(self, subset, internal);
+			return internal;
+		};
+
+		node->left = child(partitions[s]);
+		node->right = child(s ^ partitions[s]);
+		node->bound = subset_bounds[s];
+		node->area = node->left->area + node->right->area;
+		node->cost = costs[s];
+		node->num_primitives = node->left->num_primitives + node->right->num_primitives;
+		node->height = heights[s];
+
+		vec3f_t separation = (node->left->bound.centroid() - node->right->bound.centroid()).cwiseAbs();
+		separation.maxCoeff(&node->split_axis);
+	};
+	assign(assign, full, root);
 }
 
-void BVHAccel::getSample(BVHNode* node, float p, Intersection& pos, float& pdf) const
+void BVHAccel::compress()
 {
-	if (!node->left && !node->right) {
-		node->primitive->sample(pos, pdf);
-		pdf *= node->area;
+	if (!root || LAZY)
 		return;
+
+	nodes.clear();
+	if (isLeaf(root) && root->num_primitives > 255)
+		emitLeaf(root->bound, root->first_offset, root->num_primitives);
+	else if (isLeaf(root)) {
+		auto& node = nodes.emplace_back();
+		setBox(node, root->bound);
+		quantize(node, 0, root->bound);
+		node.flags = CompressedBVHNode::EMPTY_CHILD;
+		node.child[0] = root->first_offset;
+		node.count[0] = static_cast<uint8_t>(root->num_primitives);
+	} else
+		emit(root);
+	nodes.shrink_to_fit();
+
+	destroy(root);
+	root = nullptr;
+}
+
+uint32_t BVHAccel::emit(const BVHNode* node)
+{
+	auto index = static_cast<uint32_t>(nodes.size());
+	nodes.emplace_back();
+	setBox(nodes[index], node->bound);
+	nodes[index].flags = static_cast<uint8_t>(node->split_axis & 3);
+
+	const BVHNode* children[2] = {node->left, node->right};
+	for (int k = 0; k < 2; k++) {
+		const BVHNode* child = children[k];
+
+		uint32_t target;
+		uint8_t  count = 0;
+		if (!isLeaf(child))
+			target = emit(child);
+		else if (child->num_primitives > 255)
+			target = emitLeaf(child->bound, child->first_offset, child->num_primitives);
+		else {
+			target = child->first_offset;
+			count = static_cast<uint8_t>(child->num_primitives);
+		}
+
+		quantize(nodes[index], k, child->bound);
+		nodes[index].child[k] = target;
+		nodes[index].count[k] = count;
 	}
 
-	if (p < node->left->area)
-		getSample(node->left, p, pos, pdf);
-	else
-		getSample(node->right, p, pos, pdf);
+	return index;
+}
+
+uint32_t BVHAccel::emitLeaf(const Bound& bound, int first_offset, int num_primitives)
+{
+	// leaves beyond the 8-bit count are split into halves sharing the leaf's box
+	auto index = static_cast<uint32_t>(nodes.size());
+	nodes.emplace_back();
+	setBox(nodes[index], bound);
+
+	int counts[2] = {num_primitives / 2, num_primitives - num_primitives / 2};
+	int offsets[2] = {first_offset, first_offset + counts[0]};
+	for (int k = 0; k < 2; k++) {
+		uint32_t target = counts[k] > 255 ? emitLeaf(bound, offsets[k], counts[k]) : static_cast<uint32_t>(offsets[k]);
+
+		quantize(nodes[index], k, bound);
+		nodes[index].child[k] = target;
+		nodes[index].count[k] = counts[k] > 255 ? 0 : static_cast<uint8_t>(counts[k]);
+	}
+
+	return index;
+}
+
+size_t BVHAccel::memoryUsage() const
+{
+	auto count = [](auto& self, const BVHNode* node) -> size_t {
+		return node ? 1 + self(self, node->left) + self(self, node->right) : 0;
+	};
+
+	return count(count, root) * sizeof(BVHNode) +
+	       nodes.capacity() * sizeof(CompressedBVHNode) +
+	       indices.capacity() * sizeof(uint32_t) +
+	       weights.capacity() * sizeof(float) +
+	       cdf.capacity() * sizeof(float);
+}
+
+Bound BVHAccel::bound() const
+{
+	return root_bound;
 }
@@ -1,44 +1,320 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <numeric>
+
 #include "Bound.hpp"
 #include "Primitive.hpp"
+#include "TraceStats.hpp"
 
 enum class BVHBuildMethod {
 	NAIVE,
-	SAH
+	SAH,
+	SBVH
+};
+
+struct BVHBuildOptions {
+	int            max_primitives_per_leaf{1};
+	BVHBuildMethod method{BVHBuildMethod::NAIVE};
+	bool           lazy{false};
+
+	// extra references SBVH spatial splits may create, as a fraction of the primitive count
+	float duplication_budget{0.3f};
+
+	// bound of primitive id clipped to a box, by default its bound intersected with the box
+	std::function<Bound(uint32_t, const Bound&)> clip;
+
+	// treelet restructuring passes run after an eager build
+	int optimize_passes{0};
+
+	// flatten an eager build into quantized CompressedBVHNode and drop the pointer tree
+	bool compress{false};
 };
 
+// SAH costs of every tree optimize ran on, the scene's and each model's, gathered for one report at the end
+struct BVHOptimizeTotals {
+	std::mutex mutex;
+	size_t     trees{};
+	size_t     primitives{};
+	double     before{};
+	double     after{};
+
+	void add(size_t num_primitives, float cost_before, float cost_after);
+	void report();
+
+	static BVHOptimizeTotals& instance();
+};
+
+// leaves reference the range [first_offset, first_offset + num_primitives) of BVHAccel::indices,
+// pending nodes cover the same kind of range and are split the first time they are reached
 struct BVHNode {
-	Bound      bound{};
-	BVHNode*   left{};
-	BVHNode*   right{};
-	Primitive* primitive{};
+	Bound    bound{};
+	BVHNode* left{};
+	BVHNode* right{};
 
 	int   split_axis{};
 	int   first_offset{};
 	int   num_primitives{};
 	float area{};
+	float cost{};
+
+	int               depth{};
+	int               height{};        // levels below the node, kept while optimizing
+	std::atomic<bool> pending{false};
+};
+
+// binary node storing both child boxes as 8-bit offsets from its own box, scaled per axis by a power of two;
+// leaf children are folded into their parent
+struct CompressedBVHNode {
+	float    origin[3];
+	uint32_t child[2];        // node index of an internal child, first reference of a leaf child
+	int8_t   exponent[3];
+	uint8_t  flags;           // split axis in the low two bits, EMPTY_CHILD when only the first child exists
+	uint8_t  qmin[2][3];
+	uint8_t  qmax[2][3];
+	uint8_t  count[2];        // references of a leaf child, 0 for an internal child
+
+	static constexpr uint8_t EMPTY_CHILD = 1 << 2;
+
+	auto scale(int axis) const -> float { return std::bit_cast<float>(static_cast<uint32_t>(exponent[axis] + 127) << 23); }
+	auto childBound(int k) const -> Bound;
+};
+
+inline Bound CompressedBVHNode::childBound(int k) const
+{
+	Bound box;
+	for (int axis = 0; axis < 3; axis++) {
+		box.pmin[axis] = origin[axis] + qmin[k][axis] * scale(axis);
+		box.pmax[axis] = origin[axis] + qmax[k][axis] * scale(axis);
+	}
+
+	return box;
+}
+
+// a primitive during an SBVH build, its bound shrinks as spatial splits clip it
+struct BVHReference {
+	uint32_t id;
+	Bound    bound;
 };
 
+// hierarchy over primitive ids; the owner resolves ids to geometry through the traversal callbacks
 struct BVHAccel {
 	BVHNode* root{};
+	Bound    root_bound{};
+
+	// replaces the pointer tree once compressed, sampling then walks a cdf over the weights
+	std::vector<CompressedBVHNode> nodes;
+	mutable std::vector<float>     cdf;
+	mutable std::once_flag         cdf_built;
+
+	// ids are reordered within a pending node's range when it is expanded; with spatial splits
+	// a primitive may be referenced by several leaves but only one of them carries its sampling weight
+	mutable std::vector<uint32_t> indices;
+	mutable std::vector<float>    weights;
+	std::vector<float>            areas;
+	std::vector<Bound>            bounds;
+	std::vector<vec3f_t>          centroids;
+	mutable std::mutex            expand_mutex;
 
 	const int            MAX_PRIMITIVES_PER_LEAF;
 	const BVHBuildMethod BUILD_METHOD;
+	const bool           LAZY;
+	const float          DUPLICATION_BUDGET;
+
+	std::function<Bound(uint32_t, const Bound&)> clip;
 
-	BVHAccel(std::vector<Primitive*> primitives,
-	         int                     max_primitives_per_leaf = 1,
-	         BVHBuildMethod          build_method = BVHBuildMethod::NAIVE);
+	// number of levels built per step in lazy mode
+	static constexpr int LAZY_LEVELS = 4;
+	// keeps traversal within its fixed stack, restructuring never moves a leaf below it either
+	static constexpr int MAX_DEPTH = 64;
+
+	// SAH weights of a node visit and of a primitive test
+	static constexpr float TRAVERSAL_COST = 1.2f;
+	static constexpr float INTERSECTION_COST = 1.0f;
+	static constexpr int   TREELET_SIZE = 7;
+
+	BVHAccel(std::vector<Bound>        primitive_bounds,
+	         const std::vector<float>& primitive_areas,
+	         const BVHBuildOptions&    options = {});
 	~BVHAccel();
 
-	auto build(std::vector<Primitive*> primitives) -> BVHNode*;
+	auto build(int begin, int end, int levels, int depth) const -> BVHNode*;
+	auto buildSpatial(std::vector<BVHReference>& references, int depth, float root_area, size_t& budget, std::vector<bool>& owned) -> BVHNode*;
+	auto expand(BVHNode* node) const -> void;
 	auto destroy(BVHNode* node) -> void;
 
+	// SAH cost of the tree relative to the root's surface area, pending nodes count as leaves
+	auto cost() const -> float;
+	auto optimize(int passes) -> void;
+	auto restructure(BVHNode* node, int depth) -> void;
+	auto restructureTreelet(BVHNode* root, int depth) -> void;
+
+	auto compress() -> void;
+	auto emit(const BVHNode* node) -> uint32_t;
+	auto emitLeaf(const Bound& bound, int first_offset, int num_primitives) -> uint32_t;
+	auto memoryUsage() const -> size_t;
+
 	auto bound() const -> Bound;
 
-	auto intersect(const Ray& ray) const -> Intersection;
-	auto getIntersection(BVHNode* node, const Ray& ray) const -> Intersection;
+	// intersect(id, closest) replaces closest and returns true when primitive id is hit nearer
+	template <typename F>
+	bool intersect(const Ray& ray, HitRecord& closest, F&& intersect) const;
+	template <typename F>
+	bool intersectCompressed(const Ray& ray, HitRecord& closest, F&& intersect) const;
 
-	void sample(Intersection& pos, float& pdf) const;
-	void getSample(BVHNode* node, float p, Intersection& pos, float& pdf) const;
+	// sample(id, pos, pdf) samples primitive id uniformly by area
+	template <typename F>
+	void sample(Intersection& pos, float& pdf, F&& sample) const;
 };
+
+template <typename F>
+bool BVHAccel::intersect(const Ray& ray, HitRecord& closest, F&& intersect) const
+{
+	if (!nodes.empty())
+		return intersectCompressed(ray, closest, intersect);
+
+	bool hit = false;
+	if (!root)
+		return hit;
+
+	vec3f_t            inv_dir = ray.direction.cwiseInverse();
+	std::array<int, 3> dir_is_neg = {inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0};
+
+	BVHNode* stack[128];
+	int      top = 0;
+	stack[top++] = root;
+
+	uint32_t visits = 0, boxes = 0, primitives = 0;
+	while (top > 0) {
+		BVHNode* node = stack[--top];
+		boxes++;
+		if (!node->bound.intersectp(ray, inv_dir, dir_is_neg, closest.t))
+			continue;
+		visits++;
+
+		if (node->pending.load(std::memory_order_acquire))
+			expand(node);
+
+		if (!node->left && !node->right) {
+			for (int i = node->first_offset; i < node->first_offset + node->num_primitives; i++)
+				hit |= intersect(indices[i], closest);
+			primitives += node->num_primitives;
+			continue;
+		}
+
+		// visit the near child first so the far one is culled by the closer hit
+		if (dir_is_neg[node->split_axis]) {
+			stack[top++] = node->left;
+			stack[top++] = node->right;
+		} else {
+			stack[top++] = node->right;
+			stack[top++] = node->left;
+		}
+	}
+
+	TraceStats::traversal(visits, boxes, primitives);
+	return hit;
+}
+
+template <typename F>
+bool BVHAccel::intersectCompressed(const Ray& ray, HitRecord& closest, F&& intersect) const
+{
+	vec3f_t            inv_dir = ray.direction.cwiseInverse();
+	std::array<int, 3> dir_is_neg = {inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0};
+
+	bool     hit = false;
+	uint32_t stack[128];
+	int      top = 0;
+	stack[top++] = 0;
+
+	uint32_t visits = 0, boxes = 0, primitives = 0;
+	while (top > 0) {
+		const CompressedBVHNode& node = nodes[stack[--top]];
+		visits++;
+
+		// children in near-to-far order along the split axis
+		int first = dir_is_neg[node.flags & 3] ? 1 : 0;
+		int children = node.flags & CompressedBVHNode::EMPTY_CHILD ? 1 : 2;
+		if (children == 1)
+			first = 0;
+
+		uint32_t internal[2];
+		int      internal_count = 0;
+		for (int c = 0; c < children; c++) {
+			int k = c == 0 ? first : 1 - first;
+			boxes++;
+			if (!node.childBound(k).intersectp(ray, inv_dir, dir_is_neg, closest.t))
+				continue;
+
+			if (node.count[k] == 0) {
+				internal[internal_count++] = node.child[k];
+				continue;
+			}
+			for (uint32_t i = node.child[k]; i < node.child[k] + node.count[k]; i++)
+				hit |= intersect(indices[i], closest);
+			primitives += node.count[k];
+		}
+
+		while (internal_count > 0)
+			stack[top++] = internal[--internal_count];
+	}
+
+	TraceStats::traversal(visits, boxes, primitives);
+	return hit;
+}
+
+template <typename F>
+void BVHAccel::sample(Intersection& pos, float& pdf, F&& sample) const
+{
+	if (!nodes.empty()) {
+		std::call_once(cdf_built, [this]() {
+			cdf.resize(weights.size());
+			std::partial_sum(weights.begin(), weights.end(), cdf.begin());
+		});
+
+		float total = cdf.back();
+		auto  i = std::min(static_cast<size_t>(std::upper_bound(cdf.begin(), cdf.end(), Geometry::randomFloat() * total) - cdf.begin()), cdf.size() - 1);
+		while (i > 0 && weights[i] == 0.f)
+			i--;
+
+		sample(indices[i], pos, pdf);
+		pdf *= weights[i] / total;
+		return;
+	}
+
+	if (!root)
+		return;
+
+	float    p = Geometry::randomFloat() * root->area;
+	BVHNode* node = root;
+	while (true) {
+		if (node->pending.load(std::memory_order_acquire))
+			expand(node);
+		if (!node->left || !node->right)
+			break;
+
+		if (p < node->left->area)
+			node = node->left;
+		else {
+			p -= node->left->area;
+			node = node->right;
+		}
+	}
+
+	int last = node->first_offset + node->num_primitives - 1;
+	int i = node->first_offset;
+	while (i < last && p >= weights[i]) {
+		p -= weights[i];
+		i++;
+	}
+	while (i > node->first_offset && weights[i] == 0.f)
+		i--;
+
+	sample(indices[i], pos, pdf);
+	pdf *= weights[i] / root->area;
+}
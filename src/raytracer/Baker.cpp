@@ -0,0 +1,124 @@
+#include "Baker.hpp"
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <tiny_obj_loader.h>
+
+#include "GeometryCache.hpp"
+#include "Timeline.hpp"
+
+void Baker::bake(const Scene& scene, const std::string& input, const std::string& output) const
+{
+	TraceScope scope("bake", "bake", input);
+
+	tinyobj::ObjReader       reader;
+	tinyobj::ObjReaderConfig reader_config;
+	reader_config.triangulate = true;
+	reader_config.mtl_search_path = std::filesystem::path(input).parent_path().generic_string();
+	if (!reader.ParseFromFile(input, reader_config))
+		throw std::runtime_error("Failed to load model to bake: " + input + " " + reader.Error());
+
+	const auto&          attrib = reader.GetAttrib();
+	size_t               vertex_count = attrib.vertices.size() / 3;
+	std::vector<vec3f_t> positions(vertex_count), normals(vertex_count, vec3f_t::Zero()), inward(vertex_count, vec3f_t::Zero());
+	for (size_t i = 0; i < vertex_count; i++)
+		positions[i] = vec3f_t(attrib.vertices[3 * i], attrib.vertices[3 * i + 1], attrib.vertices[3 * i + 2]);
+
+	// area weighted face normals, the obj's own normals may be split per face where the baked color cannot be
+	for (const auto& shape : reader.GetShapes()) {
+		for (size_t f = 0; f + 2 < shape.mesh.indices.size(); f += 3) {
+			int     i0 = shape.mesh.indices[f].vertex_index;
+			int     i1 = shape.mesh.indices[f + 1].vertex_index;
+			int     i2 = shape.mesh.indices[f + 2].vertex_index;
+			vec3f_t face = (positions[i1] - positions[i0]).cross(positions[i2] - positions[i0]);
+			vec3f_t centroid = (positions[i0] + positions[i1] + positions[i2]) / 3.f;
+			for (int i : {i0, i1, i2}) {
+				normals[i] += face;
+				inward[i] += (centroid - positions[i]) * face.norm();
+			}
+		}
+	}
+
+	// lifted off the surface and drawn into its faces, so a vertex where walls meet does not see behind them
+	const float    offset = scene.bvh->root_bound.diagonal().norm() * 1e-4f;
+	const Material lambert{};
+
+	std::vector<vec3f_t> colors(vertex_count, vec3f_t::Zero());
+	std::atomic<size_t>  next_vertex{0};
+	std::atomic<size_t>  completed{0};
+	std::mutex           progress_mutex;
+
+	auto bake_vertices = [&]() {
+		constexpr size_t CHUNK = 64;
+		for (size_t begin = next_vertex.fetch_add(CHUNK); begin < vertex_count; begin = next_vertex.fetch_add(CHUNK)) {
+			size_t end = std::min(begin + CHUNK, vertex_count);
+			for (size_t i = begin; i < end; i++) {
+				if (normals[i].squaredNorm() == 0.f)
+					continue;
+
+				vec3f_t normal = normals[i].normalized();
+				vec3f_t origin = positions[i] + normal * offset;
+				if (inward[i].squaredNorm() > 0.f)
+					origin += inward[i].normalized() * offset;
+				vec3f_t sum = vec3f_t::Zero();
+				for (int k = 0; k < samples_per_vertex; k++) {
+					// cosine weighted, so the cosine and pdf cancel and the plain mean is irradiance over pi
+					float   r = std::sqrt(Geometry::randomFloat());
+					float   phi = 2.f * PI * Geometry::randomFloat();
+					vec3f_t local(r * std::cos(phi), r * std::sin(phi), std::sqrt(std::max(0.f, 1.f - r * r)));
+					sum += scene.castRay(Ray(origin, lambert.toWorld(local, normal)), 0);
+				}
+				colors[i] = sum / static_cast<float>(samples_per_vertex);
+			}
+			GeometryCache::unpin();
+
+			size_t current = completed.fetch_add(end - begin) + end - begin;
+			std::lock_guard<std::mutex> lock(progress_mutex);
+			std::cout << "\rBaking: " << current << " / " << vertex_count << " vertices" << std::flush;
+		}
+	};
+
+	const int                num_threads = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<std::thread> threads;
+	for (int t = 0; t < num_threads; t++)
+		threads.emplace_back(bake_vertices);
+	for (auto& thread : threads)
+		thread.join();
+	std::cout << std::endl;
+
+	// the input is copied line by line with each vertex extended by its color, in the order tinyobj read them
+	std::ifstream source(input);
+	std::ofstream target(output);
+	if (!source.is_open() || !target.is_open())
+		throw std::runtime_error("Failed to write baked model: " + output);
+
+	std::string line;
+	size_t      vertex = 0;
+	while (std::getline(source, line)) {
+		if (line.starts_with("v ") && vertex < vertex_count) {
+			// positions keep their text, colors a previous bake left are replaced
+			std::istringstream stream(line);
+			std::string        keyword, x, y, z;
+			stream >> keyword >> x >> y >> z;
+
+			const vec3f_t& c = colors[vertex++];
+			target << "v " << x << " " << y << " " << z << " " << c.x() << " " << c.y() << " " << c.z() << "\n";
+		} else
+			target << line << "\n";
+	}
+
+	if (vertex != vertex_count)
+		throw std::runtime_error("Vertex count changed while baking: " + input);
+}
+
+std::string Baker::defaultOutput(const std::string& input)
+{
+	std::filesystem::path path(input);
+	return (path.parent_path() / (path.stem().string() + "_baked.obj")).generic_string();
+}
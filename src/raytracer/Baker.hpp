@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+
+#include "Scene.hpp"
+
+// global illumination baked into the vertex colors of an obj for the rasterizer, which modulates its textures by
+// them; every vertex stores the mean radiance arriving over its cosine weighted hemisphere, irradiance over pi, so a
+// lambertian surface of albedo rho shows rho times the baked color
+struct Baker {
+	int samples_per_vertex{64};
+
+	// the scene should contain the model so it shadows and lights itself, output is the obj with colored vertices
+	void bake(const Scene& scene, const std::string& input, const std::string& output) const;
+
+	static auto defaultOutput(const std::string& input) -> std::string;
+};
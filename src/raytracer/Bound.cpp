@@ -53,16 +53,17 @@ Bound Bound::intersect(const Bound& b) const
 	    pmax.cwiseMin(b.pmax)};
 }
 
-bool Bound::intersectp(const Ray& ray, const vec3f_t inv_dir, const std::array<int, 3>& dir_is_neg) const
+bool Bound::intersectp(const Ray& ray, const vec3f_t inv_dir, const std::array<int, 3>& dir_is_neg, float tmax) const
 {
 	vec3f_t v1 = (pmin - ray.origin).cwiseProduct(inv_dir);
 	vec3f_t v2 = (pmax - ray.origin).cwiseProduct(inv_dir);
-	vec3f_t tmin = v1.cwiseMin(v2);
-	vec3f_t tmax = v1.cwiseMax(v2);
-	float   tenter = std::max({tmin.x(), tmin.y(), tmin.z()});
-	float   texit = std::min({tmax.x(), tmax.y(), tmax.z()});
+	vec3f_t tlow = v1.cwiseMin(v2);
+	vec3f_t thigh = v1.cwiseMax(v2);
+	float   tenter = std::max({tlow.x(), tlow.y(), tlow.z()});
+	float   texit = std::min({thigh.x(), thigh.y(), thigh.z()});
 
-	return (tenter <= texit && texit >= 0);
+	// boxes entered beyond the closest hit so far cannot contain a nearer one
+	return (tenter <= texit && texit >= 0 && tenter <= tmax);
 }
 
 bool Bound::overlaps(const Bound& b1, const Bound& b2)
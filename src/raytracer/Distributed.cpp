@@ -0,0 +1,191 @@
+#include "Distributed.hpp"
+
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+void CameraSettings::apply(Raytracer& raytracer) const
+{
+	raytracer.camera_position = vec3f_t(position[0], position[1], position[2]);
+	raytracer.camera_target = vec3f_t(target[0], target[1], target[2]);
+	raytracer.camera_up = vec3f_t(up[0], up[1], up[2]);
+	raytracer.fov = fov;
+}
+
+CameraSettings CameraSettings::from(const Raytracer& raytracer)
+{
+	CameraSettings settings{};
+	for (int i = 0; i < 3; i++) {
+		settings.position[i] = raytracer.camera_position[i];
+		settings.target[i] = raytracer.camera_target[i];
+		settings.up[i] = raytracer.camera_up[i];
+	}
+	settings.fov = raytracer.fov;
+
+	return settings;
+}
+
+Worker::Worker(Scene& scene) :
+    scene(&scene)
+{
+	raytracer.setup(scene);
+}
+
+void Worker::serve(const std::string& address)
+{
+	Socket listener = Socket::listen(address);
+	if (!listener.valid())
+		exit(1);
+
+	std::cout << "Worker listening on " << address << std::endl;
+	while (true) {
+		Socket connection = listener.accept();
+		while (connection.valid() && handle(connection))
+			;
+	}
+}
+
+bool Worker::handle(const Socket& connection)
+{
+	MessageType       type;
+	std::vector<char> payload;
+	if (!connection.recvMessage(type, payload) || type != MessageType::RENDER_TILE)
+		return false;
+
+	TileJob job;
+	size_t  offset = 0;
+	if (!unpack(payload, offset, job))
+		return false;
+
+	if (job.x0 < 0 || job.y0 < 0 || job.x1 > job.width || job.y1 > job.height || job.x0 >= job.x1 || job.y0 >= job.y1) {
+		std::cerr << "Rejected tile job outside of the frame" << std::endl;
+		return false;
+	}
+
+	CameraSettings current = CameraSettings::from(raytracer);
+	if (scene->width != job.width || scene->height != job.height || std::memcmp(&current, &job.camera, sizeof(current)) != 0) {
+		scene->width = job.width;
+		scene->height = job.height;
+		job.camera.apply(raytracer);
+		raytracer.setup(*scene);
+	}
+
+	Tile                 tile{job.x0, job.y0, job.x1, job.y1};
+	std::vector<vec3f_t> accumulation(tile.width() * tile.height(), vec3f_t::Zero());
+	raytracer.renderRegion(tile, job.sample_count, accumulation);
+
+	std::vector<char> result;
+	result.reserve(sizeof(job) + accumulation.size() * 3 * sizeof(float));
+	pack(result, job);
+	for (const auto& color : accumulation) {
+		pack(result, color.x());
+		pack(result, color.y());
+		pack(result, color.z());
+	}
+
+	return connection.sendMessage(MessageType::TILE_RESULT, result);
+}
+
+Coordinator::Coordinator(std::vector<std::string> workers) :
+    workers(std::move(workers))
+{}
+
+void Coordinator::render(Raytracer& raytracer, Scene& scene)
+{
+	raytracer.setup(scene);
+
+	const int width = scene.width;
+	const int height = scene.height;
+	const int samples = raytracer.samples_per_pixel;
+	const int chunk = samples_per_job > 0 ? samples_per_job : samples;
+	const auto camera = CameraSettings::from(raytracer);
+
+	std::deque<TileJob> jobs;
+	for (const auto& tile : Raytracer::split(Tile{0, 0, width, height}, tile_size))
+		for (int s = 0; s < samples; s += chunk)
+			jobs.push_back(TileJob{tile.x0, tile.y0, tile.x1, tile.y1, width, height, std::min(chunk, samples - s), camera});
+
+	std::vector<vec3f_t> accumulation(width * height, vec3f_t::Zero());
+	std::mutex           mutex;
+	const size_t         total_jobs = jobs.size();
+	size_t               completed_jobs = 0;
+
+	auto pop = [&](TileJob& job) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (jobs.empty())
+			return false;
+		job = jobs.front();
+		jobs.pop_front();
+		return true;
+	};
+
+	auto merge = [&](const TileJob& job, const std::vector<char>& result) {
+		TileJob echoed;
+		size_t  offset = 0;
+		size_t  pixels = static_cast<size_t>(job.x1 - job.x0) * (job.y1 - job.y0);
+		if (!unpack(result, offset, echoed) || std::memcmp(&echoed, &job, sizeof(job)) != 0 ||
+		    result.size() != sizeof(job) + pixels * 3 * sizeof(float))
+			return false;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		for (int j = job.y0; j < job.y1; j++) {
+			for (int i = job.x0; i < job.x1; i++) {
+				float r, g, b;
+				unpack(result, offset, r);
+				unpack(result, offset, g);
+				unpack(result, offset, b);
+				accumulation[j * width + i] += vec3f_t(r, g, b);
+			}
+		}
+
+		std::cout << "\rRendering: " << ++completed_jobs << " / " << total_jobs << " jobs" << std::flush;
+		return true;
+	};
+
+	auto dispatch = [&](const std::string& address) {
+		Socket connection = Socket::connect(address);
+		if (!connection.valid()) {
+			std::cerr << "Failed to connect to worker " << address << std::endl;
+			return;
+		}
+
+		TileJob job;
+		while (pop(job)) {
+			std::vector<char> payload;
+			pack(payload, job);
+
+			MessageType       type;
+			std::vector<char> result;
+			if (!connection.sendMessage(MessageType::RENDER_TILE, payload) ||
+			    !connection.recvMessage(type, result) || type != MessageType::TILE_RESULT || !merge(job, result)) {
+				std::cerr << "Lost worker " << address << std::endl;
+				std::lock_guard<std::mutex> lock(mutex);
+				jobs.push_back(job);
+				return;
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (const auto& address : workers)
+		threads.emplace_back(dispatch, address);
+	for (auto& thread : threads)
+		thread.join();
+
+	// jobs left behind by unreachable workers are rendered locally
+	TileJob job;
+	while (pop(job)) {
+		Tile                 tile{job.x0, job.y0, job.x1, job.y1};
+		std::vector<vec3f_t> local(tile.width() * tile.height(), vec3f_t::Zero());
+		raytracer.renderRegion(tile, job.sample_count, local);
+
+		for (int j = tile.y0; j < tile.y1; j++)
+			for (int i = tile.x0; i < tile.x1; i++)
+				accumulation[j * width + i] += local[(j - tile.y0) * tile.width() + (i - tile.x0)];
+	}
+	std::cout << std::endl;
+
+	for (size_t i = 0; i < raytracer.framebuffer.size(); i++)
+		raytracer.framebuffer[i] = accumulation[i] / samples;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Network.hpp"
+#include "Raytracer.hpp"
+
+struct CameraSettings {
+	float position[3];
+	float target[3];
+	float up[3];
+	float fov;
+
+	void apply(Raytracer& raytracer) const;
+
+	static auto from(const Raytracer& raytracer) -> CameraSettings;
+};
+
+struct TileJob {
+	int32_t        x0, y0;
+	int32_t        x1, y1;
+	int32_t        width, height;
+	int32_t        sample_count;
+	CameraSettings camera;
+};
+
+// serves tile jobs from coordinators, keeping the scene loaded across jobs and connections
+class Worker {
+public:
+	Scene*    scene;
+	Raytracer raytracer;
+
+	explicit Worker(Scene& scene);
+
+	void serve(const std::string& address);
+	bool handle(const Socket& connection);
+};
+
+// splits a frame into tile jobs and merges the accumulation buffers the workers send back
+class Coordinator {
+public:
+	std::vector<std::string> workers;
+
+	int tile_size{32};
+	int samples_per_job{0};
+
+	explicit Coordinator(std::vector<std::string> workers);
+
+	void render(Raytracer& raytracer, Scene& scene);
+};
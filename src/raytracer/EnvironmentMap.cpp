@@ -0,0 +1,156 @@
+#include "EnvironmentMap.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <fstream>
+#include <stb_image.h>
+#include <stdexcept>
+
+namespace
+{
+float luminance(const vec3f_t& color)
+{
+	return 0.2126f * color.x() + 0.7152f * color.y() + 0.0722f * color.z();
+}
+
+// rows of a little or big endian color PFM, which stores them bottom to top
+std::vector<vec3f_t> readPfm(const std::string& path, int& width, int& height)
+{
+	std::ifstream file(path, std::ios::binary);
+	std::string   magic;
+	float         endianness = 0.f;
+	if (!(file >> magic >> width >> height >> endianness) || magic != "PF" || width <= 0 || height <= 0)
+		throw std::runtime_error("Expected a color PFM: " + path);
+	file.get();
+
+	std::vector<vec3f_t> texels(static_cast<size_t>(width) * height);
+	for (int y = height - 1; y >= 0; y--)
+		file.read(reinterpret_cast<char*>(texels[static_cast<size_t>(y) * width].data()), 3 * sizeof(float) * width);
+	if (!file)
+		throw std::runtime_error("Truncated PFM: " + path);
+
+	if ((endianness > 0.f) != (std::endian::native == std::endian::big)) {
+		for (auto& texel : texels) {
+			for (int c = 0; c < 3; c++) {
+				auto bytes = std::bit_cast<std::array<char, 4>>(texel[c]);
+				std::reverse(bytes.begin(), bytes.end());
+				texel[c] = std::bit_cast<float>(bytes);
+			}
+		}
+	}
+
+	return texels;
+}
+};        // namespace
+
+void EnvironmentMap::load(const std::string& path)
+{
+	if (path.ends_with(".pfm")) {
+		texels = readPfm(path, width, height);
+	} else {
+		stbi_set_flip_vertically_on_load_thread(false);
+		int    channels;
+		float* image = stbi_loadf(path.c_str(), &width, &height, &channels, 3);
+		if (!image)
+			throw std::runtime_error("Failed to load environment map: " + path);
+
+		texels.resize(static_cast<size_t>(width) * height);
+		for (size_t i = 0; i < texels.size(); i++)
+			texels[i] = vec3f_t(image[3 * i], image[3 * i + 1], image[3 * i + 2]);
+		stbi_image_free(image);
+	}
+
+	buildDistribution();
+}
+
+void EnvironmentMap::setConstant(const vec3f_t& radiance)
+{
+	width = height = 1;
+	texels.assign(1, radiance);
+	buildDistribution();
+}
+
+void EnvironmentMap::buildDistribution()
+{
+	marginal.assign(height + 1, 0.f);
+	conditional.assign(static_cast<size_t>(height) * (width + 1), 0.f);
+
+	// rows near the poles cover less solid angle, so their texels weigh less
+	for (int y = 0; y < height; y++) {
+		float  sin_theta = std::sin(PI * (y + .5f) / height);
+		float* row = &conditional[static_cast<size_t>(y) * (width + 1)];
+		for (int x = 0; x < width; x++)
+			row[x + 1] = row[x] + std::max(0.f, luminance(texels[static_cast<size_t>(y) * width + x])) * sin_theta;
+		marginal[y + 1] = marginal[y] + row[width];
+	}
+	total = marginal[height];
+}
+
+int EnvironmentMap::texel(const vec3f_t& direction) const
+{
+	float u = .5f + std::atan2(direction.x(), -direction.z()) / (2.f * PI);
+	float v = std::acos(std::clamp(direction.y(), -1.f, 1.f)) / PI;
+	int   x = std::clamp(static_cast<int>(u * width), 0, width - 1);
+	int   y = std::clamp(static_cast<int>(v * height), 0, height - 1);
+
+	return y * width + x;
+}
+
+vec3f_t EnvironmentMap::eval(const vec3f_t& direction) const
+{
+	if (!enabled())
+		return vec3f_t::Zero();
+
+	return texels[texel(direction)] * scale;
+}
+
+vec3f_t EnvironmentMap::sample(vec3f_t& direction, float& pdf) const
+{
+	pdf = 0.f;
+	if (!(total > 0.f))
+		return vec3f_t::Zero();
+
+	// the row from the marginal, the column from its conditional, each continuous within the chosen cell
+	auto pick = [](const float* cdf, int count, float target, float& offset) {
+		int index = static_cast<int>(std::upper_bound(cdf, cdf + count + 1, target) - cdf) - 1;
+		index = std::clamp(index, 0, count - 1);
+		float width = cdf[index + 1] - cdf[index];
+		offset = width > 0.f ? std::clamp((target - cdf[index]) / width, 0.f, 1.f) : .5f;
+		return index;
+	};
+
+	float        dv, du;
+	int          y = pick(marginal.data(), height, Geometry::randomFloat() * total, dv);
+	const float* row = &conditional[static_cast<size_t>(y) * (width + 1)];
+	int          x = pick(row, width, Geometry::randomFloat() * row[width], du);
+
+	float theta = PI * (y + dv) / height;
+	float phi = 2.f * PI * ((x + du) / width - .5f);
+	float sin_theta = std::sin(theta);
+	if (sin_theta <= 0.f)
+		return vec3f_t::Zero();
+
+	direction = vec3f_t(sin_theta * std::sin(phi), std::cos(theta), -sin_theta * std::cos(phi));
+
+	// the density over the image divided by the jacobian 2 pi^2 sin theta of the mapping to directions
+	float weight = row[x + 1] - row[x];
+	pdf = weight / total * width * height / (2.f * PI * PI * sin_theta);
+
+	return texels[static_cast<size_t>(y) * width + x] * scale;
+}
+
+float EnvironmentMap::pdf(const vec3f_t& direction) const
+{
+	if (!(total > 0.f))
+		return 0.f;
+
+	int   index = texel(direction);
+	int   x = index % width, y = index / width;
+	float sin_theta = std::sqrt(std::max(0.f, 1.f - direction.y() * direction.y()));
+	if (sin_theta <= 0.f)
+		return 0.f;
+
+	const float* row = &conditional[static_cast<size_t>(y) * (width + 1)];
+	return (row[x + 1] - row[x]) / total * width * height / (2.f * PI * PI * sin_theta);
+}
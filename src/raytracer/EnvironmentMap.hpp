@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "global.hpp"
+
+// radiance arriving from infinitely far away, an equirectangular float image with +y up; directions are importance
+// sampled through a marginal cdf over rows and a conditional cdf per row, both built once at load
+class EnvironmentMap {
+private:
+	int                  width{0};
+	int                  height{0};
+	std::vector<vec3f_t> texels;
+
+	// marginal has height + 1 entries, conditional height rows of width + 1; weights are luminance times sin theta
+	std::vector<float> marginal;
+	std::vector<float> conditional;
+	float              total{};
+
+	void buildDistribution();
+	auto texel(const vec3f_t& direction) const -> int;
+
+public:
+	float scale{1.f};
+
+	// .pfm is read directly, other formats such as .hdr through stb_image
+	void load(const std::string& path);
+	void setConstant(const vec3f_t& radiance);
+
+	auto enabled() const -> bool { return !texels.empty(); }
+	auto eval(const vec3f_t& direction) const -> vec3f_t;
+	auto sample(vec3f_t& direction, float& pdf) const -> vec3f_t;
+	auto pdf(const vec3f_t& direction) const -> float;
+};
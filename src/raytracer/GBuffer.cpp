@@ -0,0 +1,158 @@
+#include "GBuffer.hpp"
+
+#include <algorithm>
+
+#include "GeometryCache.hpp"
+#include "Raytracer.hpp"
+#include "Timeline.hpp"
+
+void GBuffer::drawTriangle(const Raytracer& raytracer, const vec2f_t& offset, uint32_t ref, uint32_t prim_id,
+                           const vec3f_t& v0, const vec3f_t& v1, const vec3f_t& v2)
+{
+	constexpr float NEAR = 1e-3f;
+
+	// back faces are culled as the raytracer's triangles cull them, edge-on triangles are never hit either
+	if ((v0 - raytracer.camera_position).dot((v1 - v0).cross(v2 - v0)) >= 0.f)
+		return;
+
+	// into camera space, whose axes are the columns of camera_to_world
+	std::array<vec3f_t, 3> view;
+	const vec3f_t*         world[3] = {&v0, &v1, &v2};
+	for (int i = 0; i < 3; i++)
+		view[i] = raytracer.camera_to_world.transpose() * (*world[i] - raytracer.camera_position);
+
+	// clipped against the near plane, which leaves a triangle or a quad
+	std::array<vec3f_t, 4> polygon;
+	int                    count = 0;
+	for (int i = 0; i < 3; i++) {
+		const vec3f_t& a = view[i];
+		const vec3f_t& b = view[(i + 1) % 3];
+		if (a.z() >= NEAR)
+			polygon[count++] = a;
+		if ((a.z() >= NEAR) != (b.z() >= NEAR))
+			polygon[count++] = a + (b - a) * ((NEAR - a.z()) / (b.z() - a.z()));
+	}
+	if (count < 3)
+		return;
+
+	// the inverse of cameraRay, so the pixel centres land where its rays go
+	std::array<vec3f_t, 4> screen;
+	for (int i = 0; i < count; i++) {
+		float x = polygon[i].x() / polygon[i].z() / (raytracer.scale * raytracer.aspect_ratio);
+		float y = polygon[i].y() / polygon[i].z() / raytracer.scale;
+		screen[i] = vec3f_t((x + 1.f) * .5f * width, (1.f - y) * .5f * height, 1.f / polygon[i].z());
+	}
+
+	fill(ref, prim_id, offset, {screen[0], screen[1], screen[2]});
+	if (count == 4)
+		fill(ref, prim_id, offset, {screen[0], screen[2], screen[3]});
+}
+
+void GBuffer::fill(uint32_t ref, uint32_t prim_id, const vec2f_t& offset, const std::array<vec3f_t, 3>& screen)
+{
+	const auto& [a, b, c] = screen;
+
+	float area = (b.x() - a.x()) * (c.y() - a.y()) - (b.y() - a.y()) * (c.x() - a.x());
+	if (area == 0.f)
+		return;
+
+	int x0 = std::max(0, static_cast<int>(std::floor(std::min({a.x(), b.x(), c.x()}) - offset.x())));
+	int x1 = std::min(width - 1, static_cast<int>(std::ceil(std::max({a.x(), b.x(), c.x()}) - offset.x())));
+	int y0 = std::max(0, static_cast<int>(std::floor(std::min({a.y(), b.y(), c.y()}) - offset.y())));
+	int y1 = std::min(height - 1, static_cast<int>(std::ceil(std::max({a.y(), b.y(), c.y()}) - offset.y())));
+
+	// edges are widened slightly so rounding never leaves a crack between neighbours, the exact test then settles
+	// which triangle a sample near a shared edge belongs to
+	constexpr float EDGE_EPSILON = 1e-4f;
+
+	auto edge = [](const vec3f_t& p, const vec3f_t& q, float x, float y) {
+		return (q.x() - p.x()) * (y - p.y()) - (q.y() - p.y()) * (x - p.x());
+	};
+
+	for (int j = y0; j <= y1; j++) {
+		for (int i = x0; i <= x1; i++) {
+			float x = i + offset.x(), y = j + offset.y();
+			float w0 = edge(b, c, x, y) / area;
+			float w1 = edge(c, a, x, y) / area;
+			float w2 = edge(a, b, x, y) / area;
+			if (w0 < -EDGE_EPSILON || w1 < -EDGE_EPSILON || w2 < -EDGE_EPSILON)
+				continue;
+
+			// inverse depth is linear in screen space, and along one pixel's ray proportional to 1 / t
+			float  depth = w0 * a.z() + w1 * b.z() + w2 * c.z();
+			size_t pixel = static_cast<size_t>(j) * width + i;
+			if (depth <= inverse_depth[pixel])
+				continue;
+
+			inverse_depth[pixel] = depth;
+			refs[pixel] = ref;
+			prim_ids[pixel] = prim_id;
+		}
+	}
+}
+
+size_t GBuffer::rasterize(const Scene& scene, const Raytracer& raytracer, const vec2f_t& offset, SurfaceHit* hits,
+                          size_t stride)
+{
+	TraceScope scope("rasterize", "render");
+
+	width = raytracer.width;
+	height = raytracer.height;
+	inverse_depth.assign(static_cast<size_t>(width) * height, 0.f);
+	refs.assign(inverse_depth.size(), NONE);
+	prim_ids.assign(inverse_depth.size(), NONE);
+
+	// spheres have no triangles, every pixel tests them analytically after the raster
+	std::vector<uint32_t> spheres;
+	for (uint32_t ref = 0; ref < scene.refs.size(); ref++) {
+		const PrimitiveRef& primitive = scene.refs[ref];
+		if (primitive.type == PrimitiveType::TRIANGLE) {
+			const Triangle& triangle = scene.triangles[primitive.index];
+			drawTriangle(raytracer, offset, ref, 0, triangle.v0, triangle.v1, triangle.v2);
+		} else if (primitive.type == PrimitiveType::MODEL) {
+			scene.models[primitive.index]->withGeometry([&](const TriangleMesh& mesh, const BVHAccel&) {
+				for (uint32_t id = 0; id < mesh.size(); id++) {
+					const auto& [i0, i1, i2] = mesh.indices[id];
+					drawTriangle(raytracer, offset, ref, id, mesh.positions[i0], mesh.positions[i1], mesh.positions[i2]);
+				}
+			});
+		} else
+			spheres.push_back(ref);
+	}
+
+	size_t traced = 0;
+	for (int j = 0; j < height; j++) {
+		for (int i = 0; i < width; i++) {
+			size_t      pixel = static_cast<size_t>(j) * width + i;
+			SurfaceHit& hit = hits[pixel * stride];
+			Ray         ray = raytracer.cameraRay(i + offset.x(), j + offset.y());
+
+			hit = SurfaceHit{};
+			if (refs[pixel] != NONE) {
+				const PrimitiveRef& primitive = scene.refs[refs[pixel]];
+				bool                exact = false;
+				if (primitive.type == PrimitiveType::TRIANGLE)
+					exact = scene.triangles[primitive.index].intersect(ray, hit.record);
+				else
+					exact = scene.models[primitive.index]->withGeometry([&](const TriangleMesh& mesh, const BVHAccel&) {
+						return mesh.intersect(prim_ids[pixel], ray, hit.record);
+					});
+
+				if (!exact) {
+					scene.closestHit(ray, hit);
+					traced++;
+					continue;
+				}
+				hit.ref = refs[pixel];
+			}
+
+			for (uint32_t ref : spheres)
+				if (scene.spheres[scene.refs[ref].index].intersect(ray, hit.record))
+					hit.ref = ref;
+		}
+	}
+
+	GeometryCache::unpin();
+
+	return traced;
+}
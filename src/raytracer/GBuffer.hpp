@@ -0,0 +1,36 @@
+#pragma once
+
+#include <array>
+#include <limits>
+#include <vector>
+
+#include "Scene.hpp"
+
+class Raytracer;
+
+// camera-view surfaces rasterized instead of ray cast: triangles are projected with the raytracer's camera and depth
+// tested per pixel as the rasterizer's drawTriangle does, then every covered pixel takes its exact record from the
+// one triangle that won it, so shading starts from the same hits a traced primary ray would find
+class GBuffer {
+private:
+	static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+	int width{};
+	int height{};
+
+	// inverse view depth of the closest triangle per pixel, its scene ref and its id within a model
+	std::vector<float>    inverse_depth;
+	std::vector<uint32_t> refs;
+	std::vector<uint32_t> prim_ids;
+
+	void drawTriangle(const Raytracer& raytracer, const vec2f_t& offset, uint32_t ref, uint32_t prim_id,
+	                  const vec3f_t& v0, const vec3f_t& v1, const vec3f_t& v2);
+	// screen holds pixel x, pixel y and inverse view depth per vertex
+	void fill(uint32_t ref, uint32_t prim_id, const vec2f_t& offset, const std::array<vec3f_t, 3>& screen);
+
+public:
+	// fills hits[pixel * stride] for the sample at offset within every pixel, returns how many pixels fell back to
+	// tracing because the exact test disagreed with the raster at a triangle's edge
+	auto rasterize(const Scene& scene, const Raytracer& raytracer, const vec2f_t& offset, SurfaceHit* hits,
+	               size_t stride) -> size_t;
+};
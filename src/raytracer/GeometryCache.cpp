@@ -0,0 +1,207 @@
+#include "GeometryCache.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include "Timeline.hpp"
+
+namespace
+{
+constexpr uint32_t GEOMETRY_FILE_MAGIC = 0x4F454752;        // "RGEO"
+constexpr uint32_t GEOMETRY_FILE_VERSION = 1;
+
+struct GeometryFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t num_vertices;
+	uint64_t num_triangles;
+	uint64_t num_nodes;
+	uint64_t num_references;
+	float    root_bound[6];
+};
+
+template <typename T>
+void writeArray(std::ofstream& output, const std::vector<T>& array)
+{
+	output.write(reinterpret_cast<const char*>(array.data()), static_cast<std::streamsize>(array.size() * sizeof(T)));
+}
+
+template <typename T>
+void readArray(std::ifstream& input, std::vector<T>& array, size_t size)
+{
+	array.resize(size);
+	input.read(reinterpret_cast<char*>(array.data()), static_cast<std::streamsize>(size * sizeof(T)));
+}
+};        // namespace
+
+size_t ModelGeometry::memoryUsage() const
+{
+	return mesh.memoryUsage() + (bvh ? bvh->memoryUsage() : 0);
+}
+
+GeometryCache::Pending GeometryCache::lookup(uint64_t key, std::promise<std::shared_ptr<const ModelGeometry>>& promise, bool& owner)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (auto it = entries.find(key); it != entries.end()) {
+		lru.splice(lru.begin(), lru, it->second.position);
+		return it->second.geometry;
+	}
+
+	owner = true;
+	lru.push_front(key);
+	auto [it, inserted] = entries.emplace(key, Entry{promise.get_future().share(), lru.begin()});
+
+	return it->second.geometry;
+}
+
+void GeometryCache::settle(uint64_t key, size_t size)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto it = entries.find(key);
+	if (it == entries.end())
+		return;
+	it->second.bytes = size;
+	bytes += size;
+
+	// geometry still held by a tracing thread stays alive through its shared_ptr after eviction
+	while (bytes > budget && lru.size() > 1) {
+		auto cold = entries.find(lru.back());
+		bytes -= cold->second.bytes;
+		entries.erase(cold);
+		lru.pop_back();
+		evictions++;
+	}
+}
+
+GeometryCache::Pins& GeometryCache::pins()
+{
+	thread_local Pins local;
+	return local;
+}
+
+void GeometryCache::unpin()
+{
+	Pins& local = pins();
+	for (auto& geometry : local.geometry)
+		geometry.reset();
+}
+
+std::filesystem::path GeometryCache::path(const std::string& file_path, const BVHBuildOptions& options) const
+{
+	// geometry files are keyed by source path, size, modification time and the hierarchy options
+	namespace fs = std::filesystem;
+
+	std::error_code ec;
+	auto            stamp = fs::last_write_time(file_path, ec).time_since_epoch().count();
+	auto            hash = std::hash<std::string>{}(fs::absolute(file_path, ec).generic_string() + ":" +
+	                                                std::to_string(fs::file_size(file_path, ec)) + ":" + std::to_string(stamp) + ":" +
+	                                                std::to_string(static_cast<int>(options.method)) + ":" +
+	                                                std::to_string(options.max_primitives_per_leaf) + ":" +
+	                                                std::to_string(options.duplication_budget) + ":" +
+	                                                std::to_string(options.optimize_passes));
+
+	return directory / (std::to_string(hash) + ".geometry");
+}
+
+size_t GeometryCache::residentBytes()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return bytes;
+}
+
+void GeometryCache::report()
+{
+	if (hits + misses == 0)
+		return;
+
+	std::cout << "Geometry cache: " << hits << " hits (" << deferred << " deferred), " << misses << " misses, " << evictions << " evictions, "
+	          << residentBytes() / (1 << 20) << " / " << budget / (1 << 20) << " MB resident" << std::endl;
+}
+
+bool GeometryCache::valid(const std::filesystem::path& path, const TriangleMesh& mesh)
+{
+	std::ifstream      input(path, std::ios::binary);
+	GeometryFileHeader header{};
+	input.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+	return input && header.magic == GEOMETRY_FILE_MAGIC && header.version == GEOMETRY_FILE_VERSION &&
+	       header.num_vertices == mesh.positions.size() && header.num_triangles == mesh.size();
+}
+
+bool GeometryCache::write(const std::filesystem::path& path, const TriangleMesh& mesh, const BVHAccel& bvh)
+{
+	namespace fs = std::filesystem;
+
+	Bound              root = bvh.bound();
+	GeometryFileHeader header{GEOMETRY_FILE_MAGIC, GEOMETRY_FILE_VERSION, mesh.positions.size(), mesh.size(), bvh.nodes.size(), bvh.indices.size(),
+	                          {root.pmin.x(), root.pmin.y(), root.pmin.z(), root.pmax.x(), root.pmax.y(), root.pmax.z()}};
+
+	// write to a temporary name first so concurrent renders never read a half-written geometry file
+	std::error_code ec;
+	fs::create_directories(path.parent_path(), ec);
+	auto temporary = path;
+	temporary += "." + std::to_string(std::hash<const void*>{}(&mesh)) + ".tmp";
+	{
+		std::ofstream output(temporary, std::ios::binary);
+		output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		writeArray(output, mesh.positions);
+		writeArray(output, mesh.normals);
+		writeArray(output, mesh.texcoords);
+		writeArray(output, mesh.indices);
+		writeArray(output, mesh.material_ids);
+		writeArray(output, bvh.nodes);
+		writeArray(output, bvh.indices);
+		writeArray(output, bvh.weights);
+		if (!output)
+			ec = std::make_error_code(std::errc::io_error);
+	}
+	if (!ec)
+		fs::rename(temporary, path, ec);
+	if (ec)
+		fs::remove(temporary, ec);
+
+	return !ec && valid(path, mesh);
+}
+
+std::shared_ptr<const ModelGeometry> GeometryCache::read(const std::filesystem::path& path, const std::vector<Material*>& materials)
+{
+	TraceScope scope("geometry page-in", "geometry", path.filename().string());
+
+	std::ifstream      input(path, std::ios::binary);
+	GeometryFileHeader header{};
+	input.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!input || header.magic != GEOMETRY_FILE_MAGIC || header.version != GEOMETRY_FILE_VERSION)
+		throw std::runtime_error("Failed to read geometry file " + path.string());
+
+	auto  geometry = std::make_shared<ModelGeometry>();
+	auto& mesh = geometry->mesh;
+	readArray(input, mesh.positions, header.num_vertices);
+	readArray(input, mesh.normals, header.num_vertices);
+	readArray(input, mesh.texcoords, header.num_vertices);
+	readArray(input, mesh.indices, header.num_triangles);
+	readArray(input, mesh.material_ids, header.num_triangles);
+	mesh.materials = materials;
+
+	// the hierarchy was flattened before it was written, so it is restored without a build
+	geometry->bvh = std::make_unique<BVHAccel>(std::vector<Bound>{}, std::vector<float>{});
+	readArray(input, geometry->bvh->nodes, header.num_nodes);
+	readArray(input, geometry->bvh->indices, header.num_references);
+	readArray(input, geometry->bvh->weights, header.num_references);
+	geometry->bvh->root_bound = Bound{
+	    vec3f_t(header.root_bound[0], header.root_bound[1], header.root_bound[2]),
+	    vec3f_t(header.root_bound[3], header.root_bound[4], header.root_bound[5])};
+
+	if (!input)
+		throw std::runtime_error("Truncated geometry file " + path.string());
+
+	return geometry;
+}
+
+GeometryCache& GeometryCache::instance()
+{
+	static GeometryCache cache;
+	return cache;
+}
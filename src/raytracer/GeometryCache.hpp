@@ -0,0 +1,119 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "BVH.hpp"
+#include "Mesh.hpp"
+
+// triangles and compressed hierarchy of a streamed model while it is paged in
+struct ModelGeometry {
+	TriangleMesh              mesh;
+	std::unique_ptr<BVHAccel> bvh;
+
+	auto memoryUsage() const -> size_t;
+};
+
+// process-wide cache of streamed model geometry with a fixed memory budget and LRU eviction
+class GeometryCache {
+private:
+	using Pending = std::shared_future<std::shared_ptr<const ModelGeometry>>;
+
+	struct Entry {
+		Pending                       geometry;
+		std::list<uint64_t>::iterator position;
+		size_t                        bytes{0};
+	};
+
+	// geometry a thread fetched since it last unpinned, direct-mapped by key and only touched by that thread
+	struct Pins {
+		static constexpr size_t SLOTS = 16;
+
+		std::array<uint64_t, SLOTS>                             keys{};
+		std::array<std::shared_ptr<const ModelGeometry>, SLOTS> geometry;
+	};
+
+	std::mutex                          mutex;
+	std::list<uint64_t>                 lru;
+	std::unordered_map<uint64_t, Entry> entries;
+	size_t                              bytes{0};
+
+	auto lookup(uint64_t key, std::promise<std::shared_ptr<const ModelGeometry>>& promise, bool& owner) -> Pending;
+	void settle(uint64_t key, size_t size);
+
+	// the shared lookup, which takes the lock
+	template <typename F>
+	auto fetchShared(uint64_t key, F&& load) -> std::shared_ptr<const ModelGeometry>
+	{
+		std::promise<std::shared_ptr<const ModelGeometry>> promise;
+		bool                                               owner = false;
+
+		// requests for geometry that is still paging in wait on the single load instead of issuing their own
+		Pending geometry = lookup(key, promise, owner);
+		if (!owner) {
+			hits++;
+			if (geometry.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+				deferred++;
+			return geometry.get();
+		}
+
+		misses++;
+		std::shared_ptr<const ModelGeometry> loaded = load();
+		promise.set_value(loaded);
+		settle(key, loaded->memoryUsage());
+
+		return loaded;
+	}
+
+	static auto pins() -> Pins&;
+
+public:
+	// streaming is off while the budget is zero
+	size_t                budget{0};
+	std::filesystem::path directory{std::filesystem::temp_directory_path() / "rasyer-geometry-cache"};
+
+	std::atomic<size_t> hits{0};
+	std::atomic<size_t> misses{0};
+	std::atomic<size_t> deferred{0};
+	std::atomic<size_t> evictions{0};
+
+	auto enabled() const -> bool { return budget > 0; }
+
+	// pinned geometry is returned without taking the lock, so a thread tracing through the same models pays the
+	// lookup once per tile rather than once per ray
+	template <typename F>
+	auto fetch(uint64_t key, F&& load) -> std::shared_ptr<const ModelGeometry>
+	{
+		Pins&  local = pins();
+		size_t slot = key % Pins::SLOTS;
+		if (local.keys[slot] == key && local.geometry[slot])
+			return local.geometry[slot];
+
+		local.keys[slot] = key;
+		local.geometry[slot] = fetchShared(key, std::forward<F>(load));
+
+		return local.geometry[slot];
+	}
+
+	// drops the calling thread's pins, render threads do so after every tile so evicted geometry is not kept alive
+	// past the budget by more than the models a tile touched
+	static void unpin();
+
+	auto path(const std::string& file_path, const BVHBuildOptions& options) const -> std::filesystem::path;
+	auto residentBytes() -> size_t;
+	void report();
+
+	// geometry files hold the mesh arrays followed by the flattened hierarchy
+	static bool valid(const std::filesystem::path& path, const TriangleMesh& mesh);
+	static bool write(const std::filesystem::path& path, const TriangleMesh& mesh, const BVHAccel& bvh);
+	static auto read(const std::filesystem::path& path, const std::vector<Material*>& materials) -> std::shared_ptr<const ModelGeometry>;
+
+	static GeometryCache& instance();
+};
@@ -1,18 +1,29 @@
 #include "Material.hpp"
 
+#include "Texture.hpp"
+
 bool Material::hasEmission() const
 {
 	return emission.norm() > 1e-6f;
 }
 
-vec3f_t Material::reflect(const vec3f_t& normal, const vec3f_t& incident)
+vec3f_t Material::albedo(const vec2f_t& texcoord, float footprint) const
+{
+	if (diffuse_map)
+		return diffuse_map->sample(texcoord.x(), texcoord.y(), footprint);
+
+	return kd;
+}
+
+vec3f_t Material::reflect(const vec3f_t& normal, const vec3f_t& incident) const
 {
 	return incident - 2 * normal.dot(incident) * normal;
 }
 
-vec3f_t Material::refract(const vec3f_t& normal, const vec3f_t& incident, float ior)
+// normal points out of the medium, incident arrives from either side
+vec3f_t Material::refract(const vec3f_t& normal, const vec3f_t& incident, float ior) const
 {
-	float   cosi = std::clamp(-1.f, 1.f, -normal.dot(incident));
+	float   cosi = std::clamp(incident.dot(normal), -1.f, 1.f);
 	float   etai = 1.0f, etat = ior;
 	vec3f_t n = normal;
 	if (cosi < 0.0f)
@@ -30,9 +41,9 @@ vec3f_t Material::refract(const vec3f_t& normal, const vec3f_t& incident, float
 		return eta * incident + (eta * cosi - std::sqrt(k)) * n;
 }
 
-float Material::fresnel(const vec3f_t& normal, const vec3f_t& incident, float ior)
+float Material::fresnel(const vec3f_t& normal, const vec3f_t& incident, float ior) const
 {
-	float cosi = std::clamp(-1.f, 1.f, -normal.dot(incident));
+	float cosi = std::clamp(incident.dot(normal), -1.f, 1.f);
 	float etai = 1.0f, etat = ior;
 	if (cosi > 0.0f)
 		std::swap(etai, etat);
@@ -64,6 +75,13 @@ vec3f_t Material::toWorld(const vec3f_t& local, const vec3f_t& normal) const
 
 vec3f_t Material::sample(const vec3f_t& wi, const vec3f_t& normal)
 {
+	// dielectrics pick the reflected or refracted direction with the fresnel reflectance as probability
+	if (type == MaterialType::DIELECTRIC) {
+		if (Geometry::randomFloat() < fresnel(normal, wi, ior))
+			return reflect(normal, wi);
+		return refract(normal, wi, ior);
+	}
+
 	float x1 = Geometry::randomFloat();
 	float x2 = Geometry::randomFloat();
 	float z = std::fabs(1.f - 2.f * x1);
@@ -75,9 +93,9 @@ vec3f_t Material::sample(const vec3f_t& wi, const vec3f_t& normal)
 	return toWorld(local, normal);
 }
 
-vec3f_t Material::eval(const vec3f_t& wi, const vec3f_t& wo, const vec3f_t& normal) const
+vec3f_t Material::eval(const vec3f_t& wi, const vec3f_t& wo, const vec3f_t& normal, const vec2f_t& texcoord, float footprint) const
 {
-	return normal.dot(wo) > .0f ? kd / PI : vec3f_t{};
+	return normal.dot(wo) > .0f ? vec3f_t(albedo(texcoord, footprint) / PI) : vec3f_t::Zero();
 }
 
 float Material::pdf(const vec3f_t& wi, const vec3f_t& wo, const vec3f_t& normal) const
@@ -2,6 +2,14 @@
 
 #include "global.hpp"
 
+struct Texture;
+
+// dielectrics are smooth glass that only reflects or refracts, everything else is lambertian
+enum class MaterialType {
+	DIFFUSE,
+	DIELECTRIC,
+};
+
 struct Material {
 	vec3f_t kd;
 	vec3f_t ks;
@@ -9,14 +17,19 @@ struct Material {
 	vec3f_t emission;
 	float   specular_exponent;
 
-	bool hasEmission() const;
+	const Texture* diffuse_map{nullptr};
+	MaterialType   type{MaterialType::DIFFUSE};
+
+	bool    hasEmission() const;
+	// footprint is the uv-space area the sample covers, as Texture::sample takes it
+	vec3f_t albedo(const vec2f_t& texcoord, float footprint = 0.f) const;
 
-	vec3f_t reflect(const vec3f_t& normal, const vec3f_t& incident);
-	vec3f_t refract(const vec3f_t& normal, const vec3f_t& incident, float ior);
-	float   fresnel(const vec3f_t& normal, const vec3f_t& incident, float ior);
+	vec3f_t reflect(const vec3f_t& normal, const vec3f_t& incident) const;
+	vec3f_t refract(const vec3f_t& normal, const vec3f_t& incident, float ior) const;
+	float   fresnel(const vec3f_t& normal, const vec3f_t& incident, float ior) const;
 	vec3f_t toWorld(const vec3f_t& local, const vec3f_t& normal) const;
 
 	vec3f_t sample(const vec3f_t& wi, const vec3f_t& normal);
-	vec3f_t eval(const vec3f_t& wi, const vec3f_t& wo, const vec3f_t& normal) const;
+	vec3f_t eval(const vec3f_t& wi, const vec3f_t& wo, const vec3f_t& normal, const vec2f_t& texcoord, float footprint = 0.f) const;
 	float   pdf(const vec3f_t& wi, const vec3f_t& wo, const vec3f_t& normal) const;
 };
@@ -0,0 +1,183 @@
+#include "Mesh.hpp"
+
+uint32_t TriangleMesh::addVertex(const vec3f_t& position, const vec3f_t& normal, const vec2f_t& texcoord)
+{
+	positions.push_back(position);
+	normals.push_back(packNormal(normal));
+	texcoords.push_back({packHalf(texcoord.x()), packHalf(texcoord.y())});
+
+	return static_cast<uint32_t>(positions.size() - 1);
+}
+
+size_t TriangleMesh::memoryUsage() const
+{
+	return positions.capacity() * sizeof(vec3f_t) +
+	       normals.capacity() * sizeof(uint32_t) +
+	       texcoords.capacity() * sizeof(std::array<uint16_t, 2>) +
+	       indices.capacity() * sizeof(std::array<uint32_t, 3>) +
+	       material_ids.capacity() * sizeof(uint16_t) +
+	       materials.capacity() * sizeof(Material*);
+}
+
+Bound TriangleMesh::bound(uint32_t id) const
+{
+	const auto& [i0, i1, i2] = indices[id];
+
+	return Bound{
+	    positions[i0].cwiseMin(positions[i1]).cwiseMin(positions[i2]),
+	    positions[i0].cwiseMax(positions[i1]).cwiseMax(positions[i2])};
+}
+
+Bound TriangleMesh::clip(uint32_t id, const Bound& box) const
+{
+	const auto& [i0, i1, i2] = indices[id];
+
+	// clip the triangle against the six box planes, each plane adds at most one vertex
+	std::array<vec3f_t, 9> buffers[2] = {{positions[i0], positions[i1], positions[i2]}, {}};
+	vec3f_t*               polygon = buffers[0].data();
+	vec3f_t*               clipped = buffers[1].data();
+	int                    count = 3;
+
+	for (int axis = 0; axis < 3; axis++) {
+		for (int side = 0; side < 2; side++) {
+			float plane = side ? box.pmax[axis] : box.pmin[axis];
+			auto  inside = [&](const vec3f_t& p) { return side ? p[axis] <= plane : p[axis] >= plane; };
+
+			if (std::all_of(polygon, polygon + count, inside))
+				continue;
+
+			int n = 0;
+			for (int k = 0; k < count; k++) {
+				const vec3f_t& a = polygon[k];
+				const vec3f_t& b = polygon[(k + 1) % count];
+				if (inside(a))
+					clipped[n++] = a;
+				if (inside(a) != inside(b)) {
+					vec3f_t p = a + (b - a) * ((plane - a[axis]) / (b[axis] - a[axis]));
+					p[axis] = plane;
+					clipped[n++] = p;
+				}
+			}
+
+			std::swap(polygon, clipped);
+			count = n;
+			if (count == 0)
+				return Bound{};
+		}
+	}
+
+	Bound result{};
+	for (int k = 0; k < count; k++)
+		result = Bound::merge(result, polygon[k]);
+
+	return result.intersect(box);
+}
+
+float TriangleMesh::area(uint32_t id) const
+{
+	const auto& [i0, i1, i2] = indices[id];
+
+	return 0.5f * (positions[i1] - positions[i0]).cross(positions[i2] - positions[i0]).norm();
+}
+
+Material* TriangleMesh::material(uint32_t id) const
+{
+	return materials[material_ids[id]];
+}
+
+vec3f_t TriangleMesh::geometricNormal(uint32_t id) const
+{
+	const auto& [i0, i1, i2] = indices[id];
+
+	return (positions[i1] - positions[i0]).cross(positions[i2] - positions[i0]).normalized();
+}
+
+vec3f_t TriangleMesh::normal(uint32_t id, float u, float v) const
+{
+	const auto& [i0, i1, i2] = indices[id];
+	if (normals[i0] == NO_NORMAL || normals[i1] == NO_NORMAL || normals[i2] == NO_NORMAL)
+		return geometricNormal(id);
+
+	return ((1.f - u - v) * unpackNormal(normals[i0]) + u * unpackNormal(normals[i1]) + v * unpackNormal(normals[i2])).normalized();
+}
+
+vec2f_t TriangleMesh::texcoord(uint32_t id, float u, float v) const
+{
+	const auto& [i0, i1, i2] = indices[id];
+	auto        unpack = [&](uint32_t i) { return vec2f_t(unpackHalf(texcoords[i][0]), unpackHalf(texcoords[i][1])); };
+
+	return (1.f - u - v) * unpack(i0) + u * unpack(i1) + v * unpack(i2);
+}
+
+float TriangleMesh::uvDensity(uint32_t id) const
+{
+	const auto& [i0, i1, i2] = indices[id];
+	auto        unpack = [&](uint32_t i) { return vec2f_t(unpackHalf(texcoords[i][0]), unpackHalf(texcoords[i][1])); };
+
+	vec2f_t t1 = unpack(i1) - unpack(i0), t2 = unpack(i2) - unpack(i0);
+	float   area = (positions[i1] - positions[i0]).cross(positions[i2] - positions[i0]).norm();
+
+	return area > 0.f ? std::abs(t1.x() * t2.y() - t1.y() * t2.x()) / area : 0.f;
+}
+
+bool TriangleMesh::intersect(uint32_t id, const Ray& ray, float& tnear, float& u, float& v) const
+{
+	const auto& [i0, i1, i2] = indices[id];
+
+	return Triangle::intersect(positions[i0], positions[i1], positions[i2], ray.origin, ray.direction, tnear, u, v);
+}
+
+bool TriangleMesh::intersect(uint32_t id, const Ray& ray, HitRecord& closest) const
+{
+	const auto& [i0, i1, i2] = indices[id];
+	const auto& v0 = positions[i0];
+
+	// back faces are culled, matching Triangle
+	vec3f_t e1 = positions[i1] - v0, e2 = positions[i2] - v0;
+	if (ray.direction.dot(e1.cross(e2)) > 0.f)
+		return false;
+
+	vec3f_t pvec = ray.direction.cross(e2);
+	float   det = e1.dot(pvec);
+	if (std::fabs(det) < 1e-8f)
+		return false;
+
+	float   inv_det = 1.0f / det;
+	vec3f_t tvec = ray.origin - v0;
+	float   u = tvec.dot(pvec) * inv_det;
+	if (u < 0 || u > 1)
+		return false;
+
+	vec3f_t qvec = tvec.cross(e1);
+	float   v = ray.direction.dot(qvec) * inv_det;
+	if (v < 0 || u + v > 1)
+		return false;
+
+	float tnear = e2.dot(qvec) * inv_det;
+	if (tnear < 0 || tnear >= closest.t)
+		return false;
+
+	closest = HitRecord{tnear, id, u, v};
+	return true;
+}
+
+void TriangleMesh::sample(uint32_t id, Intersection& pos, float& pdf) const
+{
+	float r1 = Geometry::randomFloat();
+	float r2 = Geometry::randomFloat();
+	if (r1 + r2 > 1.0f) {
+		r1 = 1.0f - r1;
+		r2 = 1.0f - r2;
+	}
+	float r3 = 1.0f - r1 - r2;
+
+	const auto& [i0, i1, i2] = indices[id];
+
+	pos.hit = true;
+	pos.position = r3 * positions[i0] + r1 * positions[i1] + r2 * positions[i2];
+	pos.normal = geometricNormal(id);
+	pos.texcoord = texcoord(id, r1, r2);
+	pos.material = material(id);
+	pos.emit = pos.material ? pos.material->emission : vec3f_t(0, 0, 0);
+	pdf = 1.0f / area(id);
+}
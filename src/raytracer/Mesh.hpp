@@ -0,0 +1,119 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "Bound.hpp"
+#include "Primitive.hpp"
+
+// marks a vertex without an authored normal, shading then falls back to the face normal
+constexpr uint32_t NO_NORMAL = 0x80008000u;
+
+// octahedral mapping of a unit vector onto two 16-bit snorm values
+inline uint32_t packNormal(const vec3f_t& normal)
+{
+	float sum = std::abs(normal.x()) + std::abs(normal.y()) + std::abs(normal.z());
+	if (!(sum > 0.f))
+		return NO_NORMAL;
+
+	vec3f_t v = normal / sum;
+	vec2f_t e(v.x(), v.y());
+	if (v.z() < 0.f)
+		e = vec2f_t((1.f - std::abs(v.y())) * (v.x() >= 0.f ? 1.f : -1.f),
+		            (1.f - std::abs(v.x())) * (v.y() >= 0.f ? 1.f : -1.f));
+
+	auto x = static_cast<int16_t>(std::round(std::clamp(e.x(), -1.f, 1.f) * 32767.f));
+	auto y = static_cast<int16_t>(std::round(std::clamp(e.y(), -1.f, 1.f) * 32767.f));
+
+	return static_cast<uint16_t>(x) | (static_cast<uint32_t>(static_cast<uint16_t>(y)) << 16);
+}
+
+inline vec3f_t unpackNormal(uint32_t packed)
+{
+	float x = static_cast<int16_t>(packed & 0xFFFF) / 32767.f;
+	float y = static_cast<int16_t>(packed >> 16) / 32767.f;
+
+	vec3f_t v(x, y, 1.f - std::abs(x) - std::abs(y));
+	if (v.z() < 0.f) {
+		float t = std::max(-v.z(), 0.f);
+		v.x() += v.x() >= 0.f ? -t : t;
+		v.y() += v.y() >= 0.f ? -t : t;
+	}
+
+	return v.normalized();
+}
+
+inline uint16_t packHalf(float value)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+
+	uint32_t sign = (bits >> 16) & 0x8000;
+	int32_t  exponent = static_cast<int32_t>((bits >> 23) & 0xFF) - 127 + 15;
+	uint32_t mantissa = bits & 0x7FFFFF;
+
+	if (exponent <= 0) {
+		if (exponent < -10)
+			return static_cast<uint16_t>(sign);
+		mantissa = (mantissa | 0x800000) >> (1 - exponent);
+		return static_cast<uint16_t>(sign | ((mantissa + 0x1000) >> 13));
+	}
+	if (exponent >= 31)
+		return static_cast<uint16_t>(sign | 0x7C00);
+
+	// round to nearest, a mantissa carry correctly bumps the exponent
+	return static_cast<uint16_t>((sign | (exponent << 10) | (mantissa >> 13)) + ((mantissa >> 12) & 1));
+}
+
+inline float unpackHalf(uint16_t half)
+{
+	uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+	uint32_t exponent = (half >> 10) & 0x1F;
+	uint32_t mantissa = half & 0x3FF;
+	uint32_t bits;
+
+	if (exponent == 0) {
+		float value = std::ldexp(static_cast<float>(mantissa), -24);
+		return sign ? -value : value;
+	}
+	if (exponent == 31)
+		bits = sign | 0x7F800000 | (mantissa << 13);
+	else
+		bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+
+	float value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+// indexed triangle storage with shared, quantized vertices; triangles are addressed by primitive id
+struct TriangleMesh {
+	std::vector<vec3f_t>                 positions;
+	std::vector<uint32_t>                normals;
+	std::vector<std::array<uint16_t, 2>> texcoords;
+
+	std::vector<std::array<uint32_t, 3>> indices;
+	std::vector<uint16_t>                material_ids;
+	std::vector<Material*>               materials;
+
+	auto size() const -> size_t { return indices.size(); }
+	auto addVertex(const vec3f_t& position, const vec3f_t& normal, const vec2f_t& texcoord) -> uint32_t;
+	auto memoryUsage() const -> size_t;
+
+	auto bound(uint32_t id) const -> Bound;
+	auto clip(uint32_t id, const Bound& box) const -> Bound;
+	auto area(uint32_t id) const -> float;
+	auto material(uint32_t id) const -> Material*;
+	auto geometricNormal(uint32_t id) const -> vec3f_t;
+	auto normal(uint32_t id, float u, float v) const -> vec3f_t;
+	auto texcoord(uint32_t id, float u, float v) const -> vec2f_t;
+	auto uvDensity(uint32_t id) const -> float;
+
+	bool intersect(uint32_t id, const Ray& ray, float& tnear, float& u, float& v) const;
+	bool intersect(uint32_t id, const Ray& ray, HitRecord& closest) const;
+	void sample(uint32_t id, Intersection& pos, float& pdf) const;
+};
@@ -1,47 +1,39 @@
-#define STB_IMAGE_IMPLEMENTATION
 #define TINYOBJLOADER_IMPLEMENTATION
 
 #include "Model.hpp"
 
+#include <atomic>
 #include <iostream>
+#include <stdexcept>
 
-Texture::Texture(const std::string& file_path, TextureType type)
-{
-	this->file_path = file_path;
-	this->type = type;
-	auto image = stbi_load(file_path.c_str(), &this->width, &this->height, &this->nrChannels, 0);
-	stbi_set_flip_vertically_on_load(true);
-
-	if (image == nullptr) {
-		std::cerr << "Failed to load texture " << file_path << std::endl;
-		exit(1);
-	}
-
-	data.resize(this->width * this->height);
-	for (int i = 0; i < this->width * this->height; i++)
-		data[i] = vec3f_t(
-		    image[i * nrChannels + 0] / 255.0f,
-		    image[i * nrChannels + 1] / 255.0f,
-		    image[i * nrChannels + 2] / 255.0f);
-
-	stbi_image_free(image);
-}
+#include "ThreadPool.hpp"
+#include "Timeline.hpp"
 
-vec3f_t Texture::sample(float u, float v) const
+namespace
 {
-	int u_img = u * width;
-	int v_img = v * height;
-	int index = u_img * width + v_img;
-	if (index < 0)
-		index = 0;
-
-	return data[index % data.size()];
-}
+struct VertexKey {
+	int position;
+	int normal;
+	int texcoord;
+
+	bool operator==(const VertexKey&) const = default;
+};
+
+struct VertexKeyHash {
+	size_t operator()(const VertexKey& key) const
+	{
+		return (static_cast<size_t>(key.position) * 73856093u) ^
+		       (static_cast<size_t>(key.normal) * 19349663u) ^
+		       (static_cast<size_t>(key.texcoord) * 83492791u);
+	}
+};
+};        // namespace
 
 Model::Model(const std::string& filepath, Material* mat)
 {
 	// get file directory and name
 	size_t      file_pos = filepath.find_last_of('/');
+	file_path = filepath;
 	std::string file_dir = filepath.substr(0, file_pos + 1);
 	std::string file_name = filepath.substr(file_pos + 1);
 	default_material = mat;
@@ -52,11 +44,10 @@ Model::Model(const std::string& filepath, Material* mat)
 	reader_config.triangulate = true;
 	reader_config.mtl_search_path = file_dir;
 
-	if (!reader.ParseFromFile(file_dir + file_name, reader_config)) {
-		if (!reader.Error().empty()) {
-			std::cerr << "TinyObjReader1: " << reader.Error() << std::endl;
-		}
-		exit(1);
+	{
+		TraceScope parse("obj parse", "model", file_name);
+		if (!reader.ParseFromFile(file_dir + file_name, reader_config))
+			throw std::runtime_error("Failed to load model " + filepath + ": " + reader.Error());
 	}
 	if (!reader.Warning().empty()) {
 		std::cerr << "TinyObjReader2: " << reader.Error() << std::endl;
@@ -76,106 +67,160 @@ Model::Model(const std::string& filepath, Material* mat)
 		    material.shininess > 0 ? material.shininess : 10.f));
 	}
 
-	// read textures
-	for (auto& material : reader.GetMaterials()) {
-		if (!material.diffuse_texname.empty())
-			textures.emplace(material.diffuse_texname, Texture(file_dir + material.diffuse_texname, TextureType::DIFFUSE));
+	// decode textures on the loader pool while the geometry is converted
+	auto&                                                 pool = ThreadPool::instance();
+	std::unordered_map<std::string, std::future<Texture>> pending_textures;
 
-		if (!material.specular_texname.empty())
-			textures.emplace(material.specular_texname, Texture(file_dir + material.specular_texname, TextureType::SPECULAR));
+	auto decode = [&](const std::string& name, TextureType type) {
+		if (!name.empty() && !pending_textures.contains(name))
+			pending_textures.emplace(name, pool.submit([path = file_dir + name, type]() { return Texture(path, type); }));
+	};
 
-		if (!material.bump_texname.empty())
-			textures.emplace(material.bump_texname, Texture(file_dir + material.bump_texname, TextureType::BUMP));
+	for (auto& material : reader.GetMaterials()) {
+		decode(material.diffuse_texname, TextureType::DIFFUSE);
+		decode(material.specular_texname, TextureType::SPECULAR);
+		decode(material.bump_texname, TextureType::BUMP);
 	}
 
 	size_t total_triangles = 0;
 	for (const auto& shape : shapes)
 		total_triangles += shape.mesh.num_face_vertices.size();
 
-	// read vertices and normals
-	std::vector<Primitive*> primitives;
-	primitives.reserve(total_triangles);
+	// material slots per face, the last slot holds the default material
+	for (auto& material : materials)
+		mesh.materials.push_back(&material);
+	mesh.materials.push_back(default_material);
+
+	if (mesh.materials.size() > std::numeric_limits<uint16_t>::max())
+		throw std::runtime_error("Too many materials in " + filepath);
+
+	// share vertices between faces that reference the same position, normal and texcoord
+	std::unordered_map<VertexKey, uint32_t, VertexKeyHash> vertex_ids;
+	mesh.indices.reserve(total_triangles);
+	mesh.material_ids.reserve(total_triangles);
+
 	for (const auto& shape : shapes) {
-		const auto& mesh = shape.mesh;
-
-		for (size_t f = 0; f < mesh.num_face_vertices.size(); f++) {
-			Triangle triangle;
-
-			size_t idx0 = mesh.indices[3 * f + 0].vertex_index;
-			size_t idx1 = mesh.indices[3 * f + 1].vertex_index;
-			size_t idx2 = mesh.indices[3 * f + 2].vertex_index;
-
-			triangle.v0 = vec3f_t(attrib.vertices[3 * idx0 + 0], attrib.vertices[3 * idx0 + 1], attrib.vertices[3 * idx0 + 2]);
-			triangle.v1 = vec3f_t(attrib.vertices[3 * idx1 + 0], attrib.vertices[3 * idx1 + 1], attrib.vertices[3 * idx1 + 2]);
-			triangle.v2 = vec3f_t(attrib.vertices[3 * idx2 + 0], attrib.vertices[3 * idx2 + 1], attrib.vertices[3 * idx2 + 2]);
-
-			if (!attrib.normals.empty()) {
-				size_t nidx0 = mesh.indices[3 * f + 0].normal_index;
-				size_t nidx1 = mesh.indices[3 * f + 1].normal_index;
-				size_t nidx2 = mesh.indices[3 * f + 2].normal_index;
-
-				if (nidx0 < attrib.normals.size() / 3) {
-					triangle.n0 = vec3f_t(attrib.normals[3 * nidx0 + 0], attrib.normals[3 * nidx0 + 1], attrib.normals[3 * nidx0 + 2]);
-					triangle.n1 = vec3f_t(attrib.normals[3 * nidx1 + 0], attrib.normals[3 * nidx1 + 1], attrib.normals[3 * nidx1 + 2]);
-					triangle.n2 = vec3f_t(attrib.normals[3 * nidx2 + 0], attrib.normals[3 * nidx2 + 1], attrib.normals[3 * nidx2 + 2]);
-				} else {
-					vec3f_t face_normal = (triangle.v1 - triangle.v0).cross(triangle.v2 - triangle.v0).normalized();
-					triangle.n0 = triangle.n1 = triangle.n2 = face_normal;
-				}
-			} else {
-				vec3f_t face_normal = (triangle.v1 - triangle.v0).cross(triangle.v2 - triangle.v0).normalized();
-				triangle.n0 = triangle.n1 = triangle.n2 = face_normal;
+		const auto& shape_mesh = shape.mesh;
+
+		for (size_t f = 0; f < shape_mesh.num_face_vertices.size(); f++) {
+			const tinyobj::index_t* corners = &shape_mesh.indices[3 * f];
+
+			bool has_normals = true, has_texcoords = true;
+			for (int k = 0; k < 3; k++) {
+				has_normals &= corners[k].normal_index >= 0 && static_cast<size_t>(corners[k].normal_index) < attrib.normals.size() / 3;
+				has_texcoords &= corners[k].texcoord_index >= 0 && static_cast<size_t>(corners[k].texcoord_index) < attrib.texcoords.size() / 2;
 			}
 
-			if (!attrib.texcoords.empty()) {
-				size_t tidx0 = mesh.indices[3 * f + 0].texcoord_index;
-				size_t tidx1 = mesh.indices[3 * f + 1].texcoord_index;
-				size_t tidx2 = mesh.indices[3 * f + 2].texcoord_index;
-
-				if (tidx0 < attrib.texcoords.size() / 2 && tidx0 != SIZE_MAX) {
-					triangle.t0 = vec2f_t(attrib.texcoords[2 * tidx0 + 0], attrib.texcoords[2 * tidx0 + 1]);
-					triangle.t1 = vec2f_t(attrib.texcoords[2 * tidx1 + 0], attrib.texcoords[2 * tidx1 + 1]);
-					triangle.t2 = vec2f_t(attrib.texcoords[2 * tidx2 + 0], attrib.texcoords[2 * tidx2 + 1]);
-				} else {
-					triangle.t0 = vec2f_t(0.0f, 0.0f);
-					triangle.t1 = vec2f_t(1.0f, 0.0f);
-					triangle.t2 = vec2f_t(0.0f, 1.0f);
+			std::array<uint32_t, 3> face{};
+			for (int k = 0; k < 3; k++) {
+				// faces without texcoords get the per-corner (0,0), (1,0), (0,1) layout
+				VertexKey key{
+				    corners[k].vertex_index,
+				    has_normals ? corners[k].normal_index : -1,
+				    has_texcoords ? corners[k].texcoord_index : -1 - k};
+
+				auto [it, inserted] = vertex_ids.try_emplace(key, 0);
+				if (inserted) {
+					int     v = key.position, n = key.normal, t = key.texcoord;
+					vec3f_t position(attrib.vertices[3 * v + 0], attrib.vertices[3 * v + 1], attrib.vertices[3 * v + 2]);
+					vec3f_t normal = n >= 0 ? vec3f_t(attrib.normals[3 * n + 0], attrib.normals[3 * n + 1], attrib.normals[3 * n + 2]) : vec3f_t::Zero();
+					vec2f_t texcoord = t >= 0 ? vec2f_t(attrib.texcoords[2 * t + 0], attrib.texcoords[2 * t + 1]) : vec2f_t(k == 1, k == 2);
+					it->second = mesh.addVertex(position, normal, texcoord);
 				}
-			} else {
-				triangle.t0 = vec2f_t(0.0f, 0.0f);
-				triangle.t1 = vec2f_t(1.0f, 0.0f);
-				triangle.t2 = vec2f_t(0.0f, 1.0f);
+				face[k] = it->second;
 			}
 
-			int mat_id = -1;
-			if (f < mesh.material_ids.size() && mesh.material_ids[f] >= 0 && mesh.material_ids[f] < materials.size())
-				mat_id = mesh.material_ids[f];
-
-			if (mat_id >= 0 && mat_id < materials.size()) {
-				triangle.material = &materials[mat_id];
-				has_emission |= triangle.material->hasEmission();
-			} else if (default_material) {
-				triangle.material = default_material;
-				has_emission |= default_material->hasEmission();
-			}
+			uint16_t slot = static_cast<uint16_t>(materials.size());
+			if (f < shape_mesh.material_ids.size() && shape_mesh.material_ids[f] >= 0 && static_cast<size_t>(shape_mesh.material_ids[f]) < materials.size())
+				slot = static_cast<uint16_t>(shape_mesh.material_ids[f]);
 
-			triangle.sarea = triangle.area();
-			total_area += triangle.sarea;
+			mesh.indices.push_back(face);
+			mesh.material_ids.push_back(slot);
 
-			triangles.push_back(triangle);
+			if (mesh.materials[slot])
+				has_emission |= mesh.materials[slot]->hasEmission();
 		}
 	}
 
-	for (auto& triangle : triangles)
-		primitives.push_back(&triangle);
+	if (mesh.size() == 0)
+		throw std::runtime_error("No triangles in " + filepath);
+
+	// compute area and bounding box, the BVH is built on first use
+	for (uint32_t i = 0; i < mesh.size(); i++) {
+		total_area += mesh.area(i);
+		bounding_box = i == 0 ? mesh.bound(i) : Bound::merge(bounding_box, mesh.bound(i));
+	}
+
+	for (auto& [name, texture] : pending_textures)
+		textures.emplace(name, pool.wait(texture));
 
-	// compute bounding box
-	bounding_box = triangles[0].bound();
-	for (const auto& triangle : triangles)
-		bounding_box = Bound::merge(bounding_box, triangle.bound());
+	const auto& obj_materials = reader.GetMaterials();
+	for (size_t i = 0; i < obj_materials.size(); i++)
+		if (!obj_materials[i].diffuse_texname.empty())
+			materials[i].diffuse_map = &textures.at(obj_materials[i].diffuse_texname);
+}
 
-	// build BVH
-	bvh = new BVHAccel(primitives);
+std::future<Model*> Model::load(const std::string& filepath, Material* material, const BVHBuildOptions& options)
+{
+	return ThreadPool::instance().submit([filepath, material, options]() {
+		auto* model = new Model(filepath, material);
+		model->bvh_options = options;
+		if (GeometryCache::instance().enabled())
+			model->stream();
+		return model;
+	});
+}
+
+const BVHAccel* Model::accel() const
+{
+	std::call_once(bvh_built, [this]() { bvh = buildAccel(bvh_options); });
+
+	return bvh;
+}
+
+BVHAccel* Model::buildAccel(const BVHBuildOptions& options) const
+{
+	std::vector<Bound> bounds(mesh.size());
+	std::vector<float> areas(mesh.size());
+	for (uint32_t i = 0; i < mesh.size(); i++) {
+		bounds[i] = mesh.bound(i);
+		areas[i] = mesh.area(i);
+	}
+
+	BVHBuildOptions clipped = options;
+	clipped.clip = [this](uint32_t id, const Bound& box) { return mesh.clip(id, box); };
+
+	return new BVHAccel(std::move(bounds), areas, clipped);
+}
+
+void Model::stream()
+{
+	static std::atomic<uint64_t> next_key{0};
+
+	auto& cache = GeometryCache::instance();
+	auto  path = cache.path(file_path, bvh_options);
+
+	// geometry files are reused between runs, otherwise the hierarchy is built flattened and written once
+	if (!GeometryCache::valid(path, mesh)) {
+		BVHBuildOptions options = bvh_options;
+		options.lazy = false;
+		options.compress = true;
+
+		std::unique_ptr<BVHAccel> tree(buildAccel(options));
+		if (!GeometryCache::write(path, mesh, *tree)) {
+			std::cerr << "Failed to write geometry cache " << path.string() << ", keeping " << file_path << " in memory" << std::endl;
+			return;
+		}
+	}
+
+	geometry_path = path;
+	geometry_key = next_key++;
+
+	mesh.positions = {};
+	mesh.normals = {};
+	mesh.texcoords = {};
+	mesh.indices = {};
+	mesh.material_ids = {};
 }
 
 Model::~Model()
@@ -194,12 +239,12 @@ float Model::area() const
 	return total_area;
 }
 
-void Model::sample(Intersection& pos, float& pdf)
+void Model::sample(Intersection& pos, float& pdf) const
 {
-	if (bvh) {
-		bvh->sample(pos, pdf);
-		pos.emit = pos.material->emission;
-	}
+	withGeometry([&](const TriangleMesh& mesh, const BVHAccel& bvh) {
+		bvh.sample(pos, pdf, [&](uint32_t id, Intersection& pos, float& pdf) { mesh.sample(id, pos, pdf); });
+	});
+	pos.primitive = this;
 }
 
 bool Model::intersect(const Ray& ray) const
@@ -209,26 +254,53 @@ bool Model::intersect(const Ray& ray) const
 
 bool Model::intersect(const Ray& ray, float& tnear, uint32_t& index) const
 {
-	bool intersected = false;
-
-	for (auto i = 0; i < triangles.size(); i++) {
-		const auto& triangle = triangles[i];
-		float       t, u, v;
-		if (Triangle::intersect(triangle.v0, triangle.v1, triangle.v2, ray.origin, ray.direction, t, u, v)) {
-			tnear = t;
-			index = i;
-			intersected |= true;
+	return withGeometry([&](const TriangleMesh& mesh, const BVHAccel&) {
+		bool intersected = false;
+
+		for (uint32_t i = 0; i < mesh.size(); i++) {
+			float t, u, v;
+			if (mesh.intersect(i, ray, t, u, v)) {
+				tnear = t;
+				index = i;
+				intersected |= true;
+			}
 		}
-	}
 
-	return intersected;
+		return intersected;
+	});
+}
+
+bool Model::intersect(const Ray& ray, HitRecord& closest) const
+{
+	return withGeometry([&](const TriangleMesh& mesh, const BVHAccel& bvh) {
+		return bvh.intersect(ray, closest, [&](uint32_t id, HitRecord& closest) { return mesh.intersect(id, ray, closest); });
+	});
+}
+
+Intersection Model::getIntersection(const Ray& ray) const
+{
+	HitRecord hit;
+	if (!intersect(ray, hit))
+		return Intersection{};
+
+	return getIntersection(ray, hit);
 }
 
-Intersection Model::getIntersection(const Ray& ray)
+Intersection Model::getIntersection(const Ray& ray, const HitRecord& hit) const
 {
 	Intersection intersection;
-	if (bvh)
-		intersection = bvh->intersect(ray);
+
+	intersection.hit = true;
+	intersection.position = ray.at(hit.t);
+	intersection.distance = hit.t;
+	intersection.primitive = this;
+	withGeometry([&](const TriangleMesh& mesh, const BVHAccel&) {
+		intersection.material = mesh.material(hit.prim_id);
+		intersection.normal = mesh.normal(hit.prim_id, hit.u, hit.v);
+		intersection.texcoord = mesh.texcoord(hit.prim_id, hit.u, hit.v);
+		if (intersection.material && intersection.material->diffuse_map)
+			intersection.uv_density = mesh.uvDensity(hit.prim_id);
+	});
 
 	return intersection;
 }
@@ -247,10 +319,13 @@ vec3f_t Model::evalDiffuse(const vec2f_t& tx) const
 
 void Model::getSurfaceProps(const vec3f_t& point, const vec3f_t& direction, uint32_t index, const vec2f_t& uv, vec3f_t& normal, vec2f_t& texcoords) const
 {
-	if (index < triangles.size())
-		triangles[index].getSurfaceProps(point, direction, index, uv, normal, texcoords);
-	else {
-		normal = vec3f_t(0, 0, 1);
-		texcoords = vec2f_t(0, 0);
-	}
+	withGeometry([&](const TriangleMesh& mesh, const BVHAccel&) {
+		if (index < mesh.size()) {
+			normal = mesh.normal(index, uv.x(), uv.y());
+			texcoords = mesh.texcoord(index, uv.x(), uv.y());
+		} else {
+			normal = vec3f_t(0, 0, 1);
+			texcoords = vec2f_t(0, 0);
+		}
+	});
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <future>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <stb_image.h>
@@ -8,33 +10,26 @@
 #include "Bound.hpp"
 #include "Primitive.hpp"
 #include "BVH.hpp"
+#include "GeometryCache.hpp"
+#include "Mesh.hpp"
+#include "Texture.hpp"
 
-enum class TextureType {
-	DIFFUSE,
-	SPECULAR,
-	BUMP
-};
-
-struct Texture {
-	int width;
-	int height;
-	int nrChannels;
-
-	std::string          file_path;
-	std::vector<vec3f_t> data;
-	TextureType          type;
-
-	Texture(const std::string& file_path, TextureType type);
-	vec3f_t sample(float u, float v) const;
-};
-
-struct Model : public Primitive {
-	std::vector<Triangle> triangles;
+struct Model final : public Primitive {
+	TriangleMesh          mesh;
 	std::vector<Material> materials;
 
 	std::unordered_map<std::string, Texture> textures;
 
-	BVHAccel* bvh{};
+	// built on first use with bvh_options, lazy options also defer its deeper levels until rays reach them
+	mutable BVHAccel*      bvh{};
+	mutable std::once_flag bvh_built;
+	BVHBuildOptions        bvh_options{4};
+
+	// once streamed, mesh keeps only its materials and the geometry is paged in from geometry_path on demand
+	std::string           file_path;
+	std::filesystem::path geometry_path;
+	uint64_t              geometry_key{};
+
 	Material* default_material{nullptr};
 
 	bool  has_emission{};
@@ -44,15 +39,40 @@ struct Model : public Primitive {
 	Model(const std::string& filepath, Material* material = nullptr);
 	~Model() override;
 
+	// streams the model right after loading when the geometry cache is enabled
+	static auto load(const std::string& filepath, Material* material = nullptr, const BVHBuildOptions& options = {4}) -> std::future<Model*>;
+
+	auto accel() const -> const BVHAccel*;
+	auto buildAccel(const BVHBuildOptions& options) const -> BVHAccel*;
+
+	void stream();
+	bool streamed() const { return !geometry_path.empty(); }
+
+	// calls f(mesh, bvh) with resident geometry, paging a streamed model in first
+	template <typename F>
+	decltype(auto) withGeometry(F&& f) const;
+
 	Bound bound() const override;
 	float area() const override;
-	void  sample(Intersection& pos, float& pdf) override;
+	void  sample(Intersection& pos, float& pdf) const override;
 
 	bool intersect(const Ray& ray) const override;
 	bool intersect(const Ray& ray, float& tnear, uint32_t& index) const override;
-	auto getIntersection(const Ray& ray) -> Intersection override;
+	bool intersect(const Ray& ray, HitRecord& closest) const override;
+	auto getIntersection(const Ray& ray) const -> Intersection override;
+	auto getIntersection(const Ray& ray, const HitRecord& hit) const -> Intersection override;
 
 	bool hasEmission() const override;
 	auto evalDiffuse(const vec2f_t& texcoords) const -> vec3f_t override;
 	void getSurfaceProps(const vec3f_t& point, const vec3f_t& direction, uint32_t index, const vec2f_t& uv, vec3f_t& normal, vec2f_t& texcoords) const override;
 };
+
+template <typename F>
+decltype(auto) Model::withGeometry(F&& f) const
+{
+	if (!streamed())
+		return f(mesh, *accel());
+
+	auto geometry = GeometryCache::instance().fetch(geometry_key, [this]() { return GeometryCache::read(geometry_path, mesh.materials); });
+	return f(geometry->mesh, *geometry->bvh);
+}
@@ -0,0 +1,266 @@
+#include "Network.hpp"
+
+#include <iostream>
+
+#ifdef _WIN32
+#	include <winsock2.h>
+#	include <ws2tcpip.h>
+#	include <afunix.h>
+#else
+#	include <netdb.h>
+#	include <netinet/in.h>
+#	include <netinet/tcp.h>
+#	include <sys/socket.h>
+#	include <sys/un.h>
+#	include <unistd.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#	define MSG_NOSIGNAL 0
+#endif
+
+namespace
+{
+void startup()
+{
+#ifdef _WIN32
+	static bool initialized = [] {
+		WSADATA data;
+		return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+	}();
+	if (!initialized)
+		std::cerr << "Failed to initialize Winsock" << std::endl;
+#endif
+}
+
+void closeHandle(intptr_t fd)
+{
+#ifdef _WIN32
+	closesocket(static_cast<SOCKET>(fd));
+#else
+	::close(static_cast<int>(fd));
+#endif
+}
+
+bool isUnix(const std::string& address)
+{
+	return address.rfind("unix:", 0) == 0;
+}
+
+sockaddr_un unixAddress(const std::string& address)
+{
+	sockaddr_un addr{};
+	addr.sun_family = AF_UNIX;
+	std::string path = address.substr(5);
+	std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+	return addr;
+}
+
+addrinfo* tcpAddress(const std::string& address, bool passive)
+{
+	size_t      colon = address.find_last_of(':');
+	std::string host = colon == std::string::npos ? "" : address.substr(0, colon);
+	std::string port = colon == std::string::npos ? address : address.substr(colon + 1);
+
+	addrinfo hints{};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = passive ? AI_PASSIVE : 0;
+
+	addrinfo* result = nullptr;
+	if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result) != 0)
+		return nullptr;
+
+	return result;
+}
+};        // namespace
+
+Socket::Socket(intptr_t fd) :
+    fd(fd)
+{}
+
+Socket::~Socket()
+{
+	close();
+}
+
+Socket::Socket(Socket&& other) noexcept :
+    fd(other.fd)
+{
+	other.fd = -1;
+}
+
+Socket& Socket::operator=(Socket&& other) noexcept
+{
+	if (this != &other) {
+		close();
+		fd = other.fd;
+		other.fd = -1;
+	}
+
+	return *this;
+}
+
+bool Socket::valid() const
+{
+	return fd != -1;
+}
+
+void Socket::close()
+{
+	if (valid())
+		closeHandle(fd);
+	fd = -1;
+}
+
+Socket Socket::accept() const
+{
+	if (!valid())
+		return Socket{};
+
+	auto client = static_cast<intptr_t>(::accept(fd, nullptr, nullptr));
+	if (client < 0)
+		return Socket{};
+
+	return Socket{client};
+}
+
+bool Socket::send(const void* data, size_t size) const
+{
+	const char* bytes = static_cast<const char*>(data);
+	while (size > 0) {
+		auto sent = ::send(fd, bytes, static_cast<int>(size), MSG_NOSIGNAL);
+		if (sent <= 0)
+			return false;
+		bytes += sent;
+		size -= sent;
+	}
+
+	return true;
+}
+
+bool Socket::recv(void* data, size_t size) const
+{
+	char* bytes = static_cast<char*>(data);
+	while (size > 0) {
+		auto received = ::recv(fd, bytes, static_cast<int>(size), 0);
+		if (received <= 0)
+			return false;
+		bytes += received;
+		size -= received;
+	}
+
+	return true;
+}
+
+bool Socket::sendMessage(MessageType type, const std::vector<char>& payload) const
+{
+	if (payload.size() > MAX_MESSAGE_SIZE)
+		return false;
+
+	MessageHeader header{static_cast<uint32_t>(type), static_cast<uint32_t>(payload.size())};
+
+	return send(&header, sizeof(header)) && send(payload.data(), payload.size());
+}
+
+bool Socket::recvMessage(MessageType& type, std::vector<char>& payload) const
+{
+	MessageHeader header{};
+	if (!recv(&header, sizeof(header)) || header.size > MAX_MESSAGE_SIZE)
+		return false;
+
+	type = static_cast<MessageType>(header.type);
+	payload.resize(header.size);
+
+	return recv(payload.data(), payload.size());
+}
+
+Socket Socket::listen(const std::string& address)
+{
+	startup();
+
+	if (isUnix(address)) {
+		sockaddr_un addr = unixAddress(address);
+		auto        fd = static_cast<intptr_t>(::socket(AF_UNIX, SOCK_STREAM, 0));
+		if (fd < 0)
+			return Socket{};
+
+		Socket socket{fd};
+#ifndef _WIN32
+		::unlink(addr.sun_path);
+#endif
+		if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(fd, SOMAXCONN) != 0) {
+			std::cerr << "Failed to listen on " << address << std::endl;
+			return Socket{};
+		}
+
+		return socket;
+	}
+
+	addrinfo* info = tcpAddress(address, true);
+	if (!info) {
+		std::cerr << "Failed to resolve " << address << std::endl;
+		return Socket{};
+	}
+
+	Socket socket;
+	for (addrinfo* p = info; p; p = p->ai_next) {
+		auto fd = static_cast<intptr_t>(::socket(p->ai_family, p->ai_socktype, p->ai_protocol));
+		if (fd < 0)
+			continue;
+
+		int reuse = 1;
+		::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+		if (::bind(fd, p->ai_addr, static_cast<int>(p->ai_addrlen)) == 0 && ::listen(fd, SOMAXCONN) == 0) {
+			socket = Socket{fd};
+			break;
+		}
+		closeHandle(fd);
+	}
+	freeaddrinfo(info);
+
+	if (!socket.valid())
+		std::cerr << "Failed to listen on " << address << std::endl;
+
+	return socket;
+}
+
+Socket Socket::connect(const std::string& address)
+{
+	startup();
+
+	if (isUnix(address)) {
+		sockaddr_un addr = unixAddress(address);
+		auto        fd = static_cast<intptr_t>(::socket(AF_UNIX, SOCK_STREAM, 0));
+		if (fd < 0)
+			return Socket{};
+
+		Socket socket{fd};
+		if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+			return Socket{};
+
+		return socket;
+	}
+
+	addrinfo* info = tcpAddress(address, false);
+	if (!info)
+		return Socket{};
+
+	Socket socket;
+	for (addrinfo* p = info; p; p = p->ai_next) {
+		auto fd = static_cast<intptr_t>(::socket(p->ai_family, p->ai_socktype, p->ai_protocol));
+		if (fd < 0)
+			continue;
+
+		if (::connect(fd, p->ai_addr, static_cast<int>(p->ai_addrlen)) == 0) {
+			int nodelay = 1;
+			::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&nodelay), sizeof(nodelay));
+			socket = Socket{fd};
+			break;
+		}
+		closeHandle(fd);
+	}
+	freeaddrinfo(info);
+
+	return socket;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+enum class MessageType : uint32_t {
+	RENDER_TILE,
+	TILE_RESULT,
+	RENDER_REQUEST,
+	TILE_DATA,
+	RENDER_DONE,
+	RENDER_ERROR
+};
+
+// messages are sent as raw host-order structs, so every process talking to each other must share the same architecture
+struct MessageHeader {
+	uint32_t type;
+	uint32_t size;
+};
+
+// larger payloads are refused before anything is allocated for them, a full frame of float pixels stays well below
+constexpr uint32_t MAX_MESSAGE_SIZE = 1u << 28;
+
+class Socket {
+private:
+	intptr_t fd{-1};
+
+public:
+	Socket() = default;
+	explicit Socket(intptr_t fd);
+	~Socket();
+
+	Socket(const Socket&) = delete;
+	Socket& operator=(const Socket&) = delete;
+	Socket(Socket&& other) noexcept;
+	Socket& operator=(Socket&& other) noexcept;
+
+	bool valid() const;
+	void close();
+	auto accept() const -> Socket;
+
+	bool send(const void* data, size_t size) const;
+	bool recv(void* data, size_t size) const;
+	bool sendMessage(MessageType type, const std::vector<char>& payload) const;
+	bool recvMessage(MessageType& type, std::vector<char>& payload) const;
+
+	// address is either "unix:<path>" or "<host>:<port>"
+	static auto listen(const std::string& address) -> Socket;
+	static auto connect(const std::string& address) -> Socket;
+};
+
+template <typename T>
+void pack(std::vector<char>& buffer, const T& value)
+{
+	const char* bytes = reinterpret_cast<const char*>(&value);
+	buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+bool unpack(const std::vector<char>& buffer, size_t& offset, T& value)
+{
+	if (offset + sizeof(T) > buffer.size())
+		return false;
+	std::memcpy(&value, buffer.data() + offset, sizeof(T));
+	offset += sizeof(T);
+	return true;
+}
@@ -0,0 +1,155 @@
+#include "PhotonMap.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <iostream>
+#include <thread>
+
+#include "GeometryCache.hpp"
+#include "Scene.hpp"
+#include "Timeline.hpp"
+
+size_t PhotonMap::hash(int64_t x, int64_t y, int64_t z) const
+{
+	uint64_t h = static_cast<uint64_t>(x) * 73856093ull ^ static_cast<uint64_t>(y) * 19349663ull ^ static_cast<uint64_t>(z) * 83492791ull;
+	return h & (cell_start.size() - 2);
+}
+
+void PhotonMap::emit(const Scene& scene, size_t count, std::vector<Photon>& stored) const
+{
+	constexpr float EPSILON = 1e-3f;
+
+	for (size_t i = 0; i < count; i++) {
+		Intersection light{};
+		float        light_pdf{};
+		scene.sampleLight(light, light_pdf);
+		if (!light.hit || !light.material || light_pdf <= 0.f)
+			continue;
+
+		// cosine-weighted emission, whose pdf cancels the cosine but for a factor of pi
+		float   u = Geometry::randomFloat();
+		float   phi = 2.f * PI * Geometry::randomFloat();
+		vec3f_t normal = light.normal.normalized();
+		vec3f_t local(std::sqrt(u) * std::cos(phi), std::sqrt(u) * std::sin(phi), std::sqrt(1.f - u));
+		vec3f_t power = light.emit * PI / light_pdf / static_cast<float>(photons_per_pass);
+
+		Ray  ray(light.position + normal * EPSILON, light.material->toWorld(local, normal).normalized());
+		bool specular = false;
+		for (int bounce = 0; bounce < MAX_BOUNCES; bounce++) {
+			Intersection hit = scene.intersect(ray);
+			if (!hit.hit || !hit.material || hit.material->hasEmission())
+				break;
+
+			// only caustics are stored, diffuse light transport stays with the path tracer
+			if (hit.material->type != MaterialType::DIELECTRIC) {
+				if (specular)
+					stored.push_back(Photon{hit.position, ray.direction, power});
+				break;
+			}
+
+			vec3f_t surface_normal = hit.normal.normalized();
+			vec3f_t direction = hit.material->sample(ray.direction, surface_normal).normalized();
+			ray = Ray(hit.position + surface_normal * (direction.dot(surface_normal) > 0.f ? EPSILON : -EPSILON), direction);
+			specular = true;
+		}
+	}
+
+	GeometryCache::unpin();
+}
+
+void PhotonMap::buildGrid()
+{
+	// counting sort of the photons by cell hash, the table has about one bucket per photon
+	cell_size = 2.f * radius;
+	cell_start.assign(std::bit_ceil(std::max<size_t>(photons.size(), 1)) + 1, 0);
+
+	std::vector<size_t> hashes(photons.size());
+	for (size_t i = 0; i < photons.size(); i++) {
+		const vec3f_t& p = photons[i].position;
+		hashes[i] = hash(static_cast<int64_t>(std::floor(p.x() / cell_size)),
+		                 static_cast<int64_t>(std::floor(p.y() / cell_size)),
+		                 static_cast<int64_t>(std::floor(p.z() / cell_size)));
+		cell_start[hashes[i] + 1]++;
+	}
+	for (size_t h = 1; h < cell_start.size(); h++)
+		cell_start[h] += cell_start[h - 1];
+
+	std::vector<Photon>   sorted(photons.size());
+	std::vector<uint32_t> next(cell_start.begin(), cell_start.end() - 1);
+	for (size_t i = 0; i < photons.size(); i++)
+		sorted[next[hashes[i]]++] = photons[i];
+	photons = std::move(sorted);
+}
+
+void PhotonMap::trace(const Scene& scene)
+{
+	TraceScope scope("photon pass", "render");
+
+	pass++;
+	radius = pass == 1 ? initial_radius : radius * std::sqrt((pass - 1 + alpha) / pass);
+
+	const size_t                     num_threads = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<std::vector<Photon>> stored(num_threads);
+	std::vector<std::thread>         threads;
+	for (size_t t = 0; t < num_threads; t++) {
+		size_t count = photons_per_pass / num_threads + (t < photons_per_pass % num_threads);
+		threads.emplace_back([&, t, count]() { emit(scene, count, stored[t]); });
+	}
+	for (auto& thread : threads)
+		thread.join();
+
+	photons.clear();
+	for (auto& part : stored)
+		photons.insert(photons.end(), part.begin(), part.end());
+
+	buildGrid();
+}
+
+vec3f_t PhotonMap::gather(const vec3f_t& position, const vec3f_t& normal, const vec3f_t& brdf) const
+{
+	if (photons.empty())
+		return vec3f_t::Zero();
+
+	// cells are twice the radius wide, so the sphere lies within the centre's cell and the neighbour on the nearer
+	// side of each axis; picking those two rather than flooring both ends of the sphere keeps rounding from reaching
+	// a third. distinct cells can share a bucket, which must still be visited once
+	std::array<size_t, 8> visited;
+	int                   num_visited = 0;
+	float                 radius2 = radius * radius;
+	vec3f_t               flux = vec3f_t::Zero();
+
+	vec3f_t scaled = position / cell_size;
+	int64_t lower[3];
+	for (int axis = 0; axis < 3; axis++) {
+		float cell = std::floor(scaled[axis]);
+		lower[axis] = static_cast<int64_t>(cell) - (scaled[axis] - cell < .5f ? 1 : 0);
+	}
+	for (int64_t x = lower[0]; x <= lower[0] + 1; x++) {
+		for (int64_t y = lower[1]; y <= lower[1] + 1; y++) {
+			for (int64_t z = lower[2]; z <= lower[2] + 1; z++) {
+				size_t h = hash(x, y, z);
+				if (std::find(visited.begin(), visited.begin() + num_visited, h) != visited.begin() + num_visited)
+					continue;
+				visited[num_visited++] = h;
+
+				for (uint32_t i = cell_start[h]; i < cell_start[h + 1]; i++) {
+					const Photon& photon = photons[i];
+					if ((photon.position - position).squaredNorm() < radius2 && photon.direction.dot(normal) < 0.f)
+						flux += photon.power;
+				}
+			}
+		}
+	}
+
+	return brdf.cwiseProduct(flux) / (PI * radius2);
+}
+
+void PhotonMap::report() const
+{
+	if (!ready())
+		return;
+
+	std::cout << "Photon map: " << pass << " passes of " << photons_per_pass << " photons, " << photons.size()
+	          << " caustic photons in the last, final radius " << radius << std::endl;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+
+#include "global.hpp"
+
+struct Scene;
+
+// power that reached a diffuse surface from an emitter through at least one dielectric
+struct Photon {
+	vec3f_t position;
+	vec3f_t direction;
+	vec3f_t power;
+};
+
+// caustic photon map for probabilistic progressive photon mapping: each pass traces a fresh set of photons and
+// gathers them within a radius that shrinks from pass to pass, so the average of the passes converges
+class PhotonMap {
+private:
+	static constexpr int MAX_BOUNCES = 16;
+
+	// photons sorted by the hash of their grid cell, cell_start[h] up to cell_start[h + 1] belong to hash h
+	std::vector<Photon>   photons;
+	std::vector<uint32_t> cell_start;
+	float                 cell_size{};
+	int                   pass{0};
+
+	auto hash(int64_t x, int64_t y, int64_t z) const -> size_t;
+	void emit(const Scene& scene, size_t count, std::vector<Photon>& stored) const;
+	void buildGrid();
+
+public:
+	size_t photons_per_pass{0};
+	float  initial_radius{1.f};
+	float  alpha{2.f / 3.f};
+	float  radius{};
+
+	auto enabled() const -> bool { return photons_per_pass > 0; }
+	auto ready() const -> bool { return pass > 0; }
+
+	// traces the next pass, shrinking the radius first; the scene must not change during a pass
+	void trace(const Scene& scene);
+	auto gather(const vec3f_t& position, const vec3f_t& normal, const vec3f_t& brdf) const -> vec3f_t;
+	void report() const;
+};
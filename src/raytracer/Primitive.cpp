@@ -41,7 +41,7 @@ float Triangle::area() const
 	return 0.5f * (v1 - v0).cross(v2 - v0).norm();
 }
 
-void Triangle::sample(Intersection& pos, float& pdf)
+void Triangle::sample(Intersection& pos, float& pdf) const
 {
 	float r1 = Geometry::randomFloat();
 	float r2 = Geometry::randomFloat();
@@ -71,43 +71,55 @@ bool Triangle::intersect(const Ray& ray, float& tnear, uint32_t& index) const
 	return false;
 }
 
-Intersection Triangle::getIntersection(const Ray& ray)
+bool Triangle::intersect(const Ray& ray, HitRecord& closest) const
 {
-	Intersection intersection;
-
 	vec3f_t e1 = v1 - v0, e2 = v2 - v0;
-	vec3f_t normal = e1.cross(e2).normalized();
-	if (ray.direction.dot(normal) > 0.f)
-		return intersection;
+	if (ray.direction.dot(e1.cross(e2)) > 0.f)
+		return false;
 
-	float   u, v, tnear{};
 	vec3f_t pvec = ray.direction.cross(e2);
 	float   det = e1.dot(pvec);
 	if (std::fabs(det) < 1e-8f)
-		return intersection;
+		return false;
 
 	float   inv_det = 1.0f / det;
 	vec3f_t tvec = ray.origin - v0;
-	u = tvec.dot(pvec) * inv_det;
+	float   u = tvec.dot(pvec) * inv_det;
 	if (u < 0 || u > 1)
-		return intersection;
+		return false;
 
 	vec3f_t qvec = tvec.cross(e1);
-	v = ray.direction.dot(qvec) * inv_det;
+	float   v = ray.direction.dot(qvec) * inv_det;
 	if (v < 0 || u + v > 1)
-		return intersection;
+		return false;
 
-	tnear = e2.dot(qvec) * inv_det;
-	if (tnear < 0)
-		return intersection;
+	float tnear = e2.dot(qvec) * inv_det;
+	if (tnear < 0 || tnear >= closest.t)
+		return false;
+
+	closest = HitRecord{tnear, 0, u, v};
+	return true;
+}
+
+Intersection Triangle::getIntersection(const Ray& ray) const
+{
+	HitRecord hit;
+	if (!intersect(ray, hit))
+		return Intersection{};
+
+	return getIntersection(ray, hit);
+}
+
+Intersection Triangle::getIntersection(const Ray& ray, const HitRecord& hit) const
+{
+	Intersection intersection;
 
 	intersection.hit = true;
-	intersection.position = ray.at(tnear);
-	intersection.distance = tnear;
-	intersection.texcoord = vec2f_t(u, v);
-	intersection.normal = normal;
+	intersection.position = ray.at(hit.t);
+	intersection.distance = hit.t;
 	intersection.material = this->material;
 	intersection.primitive = this;
+	getSurfaceProps(intersection.position, ray.direction, hit.prim_id, vec2f_t(hit.u, hit.v), intersection.normal, intersection.texcoord);
 
 	return intersection;
 }
@@ -144,7 +156,7 @@ float Sphere::area() const
 	return 4.0f * PI * radius * radius;
 }
 
-void Sphere::sample(Intersection& pos, float& pdf)
+void Sphere::sample(Intersection& pos, float& pdf) const
 {
 	float u1 = Geometry::randomFloat() * 2.0f * PI;
 	float u2 = Geometry::randomFloat() * PI;
@@ -205,28 +217,37 @@ bool Sphere::intersect(const Ray& ray, float& tnear, uint32_t& index) const
 	return true;
 }
 
-Intersection Sphere::getIntersection(const Ray& ray)
+bool Sphere::intersect(const Ray& ray, HitRecord& closest) const
+{
+	float    tnear;
+	uint32_t index;
+	if (!intersect(ray, tnear, index) || tnear >= closest.t)
+		return false;
+
+	closest = HitRecord{tnear, 0, 0.f, 0.f};
+	return true;
+}
+
+Intersection Sphere::getIntersection(const Ray& ray) const
+{
+	HitRecord hit;
+	if (!intersect(ray, hit))
+		return Intersection{};
+
+	return getIntersection(ray, hit);
+}
+
+Intersection Sphere::getIntersection(const Ray& ray, const HitRecord& hit) const
 {
 	Intersection intersection;
-	float        tnear;
-	uint32_t     index;
-	vec3f_t      local_point = (intersection.position - center) / radius;
-	float        phi = std::atan2(local_point.z(), local_point.x());
-	float        theta = std::acos(std::clamp(local_point.y(), -1.f, 1.f));
-	float        u = (phi + PI) / (2.f * PI);
-	float        v = theta / PI;
-
-	intersection.hit = intersect(ray, tnear, index);
-	if (!intersection.hit)
-		return intersection;
-
-	intersection.position = ray.origin + ray.direction * tnear;
-	intersection.normal = (intersection.position - center).normalized();
+
+	intersection.hit = true;
+	intersection.position = ray.at(hit.t);
+	intersection.distance = hit.t;
 	intersection.material = this->material;
 	intersection.primitive = this;
-	intersection.distance = tnear;
-	intersection.texcoord = vec2f_t(u, v);
 	intersection.emit = vec3f_t(0, 0, 0);
+	getSurfaceProps(intersection.position, ray.direction, hit.prim_id, vec2f_t(hit.u, hit.v), intersection.normal, intersection.texcoord);
 
 	return intersection;
 }
@@ -4,23 +4,37 @@
 #include "Bound.hpp"
 #include "Material.hpp"
 
+enum class PrimitiveType : uint8_t {
+	TRIANGLE,
+	SPHERE,
+	MODEL
+};
+
+// a scene-level primitive id resolved to the typed array it is stored in
+struct PrimitiveRef {
+	PrimitiveType type;
+	uint32_t      index;
+};
+
 struct Primitive {
 	virtual ~Primitive() = default;
 
 	virtual Bound bound() const = 0;
 	virtual float area() const = 0;
-	virtual void  sample(Intersection& pos, float& pdf) = 0;
+	virtual void  sample(Intersection& pos, float& pdf) const = 0;
 
 	virtual bool intersect(const Ray& ray) const = 0;
 	virtual bool intersect(const Ray& ray, float& tnear, uint32_t& index) const = 0;
-	virtual auto getIntersection(const Ray& ray) -> Intersection = 0;
+	virtual bool intersect(const Ray& ray, HitRecord& closest) const = 0;
+	virtual auto getIntersection(const Ray& ray) const -> Intersection = 0;
+	virtual auto getIntersection(const Ray& ray, const HitRecord& hit) const -> Intersection = 0;
 
 	virtual bool hasEmission() const = 0;
 	virtual auto evalDiffuse(const vec2f_t& texcoords) const -> vec3f_t = 0;
 	virtual void getSurfaceProps(const vec3f_t& point, const vec3f_t& direction, uint32_t index, const vec2f_t& uv, vec3f_t& normal, vec2f_t& texcoords) const = 0;
 };
 
-struct Triangle : public Primitive {
+struct Triangle final : public Primitive {
 	vec3f_t   v0, v1, v2;
 	vec3f_t   n0, n1, n2;
 	vec2f_t   t0, t1, t2;
@@ -29,11 +43,13 @@ struct Triangle : public Primitive {
 
 	Bound bound() const override;
 	float area() const override;
-	void  sample(Intersection& pos, float& pdf) override;
+	void  sample(Intersection& pos, float& pdf) const override;
 
 	bool intersect(const Ray& ray) const override;
 	bool intersect(const Ray& ray, float& tnear, uint32_t& index) const override;
-	auto getIntersection(const Ray& ray) -> Intersection override;
+	bool intersect(const Ray& ray, HitRecord& closest) const override;
+	auto getIntersection(const Ray& ray) const -> Intersection override;
+	auto getIntersection(const Ray& ray, const HitRecord& hit) const -> Intersection override;
 
 	bool hasEmission() const override;
 	auto evalDiffuse(const vec2f_t& texcoords) const -> vec3f_t override;
@@ -44,7 +60,7 @@ struct Triangle : public Primitive {
 	                      float& tnear, float& u, float& v);
 };
 
-struct Sphere : public Primitive {
+struct Sphere final : public Primitive {
 	vec3f_t center;
 	float   radius;
 
@@ -52,11 +68,13 @@ struct Sphere : public Primitive {
 
 	Bound bound() const override;
 	float area() const override;
-	void  sample(Intersection& pos, float& pdf) override;
+	void  sample(Intersection& pos, float& pdf) const override;
 
 	bool intersect(const Ray& ray) const override;
 	bool intersect(const Ray& ray, float& tnear, uint32_t& index) const override;
-	auto getIntersection(const Ray& ray) -> Intersection override;
+	bool intersect(const Ray& ray, HitRecord& closest) const override;
+	auto getIntersection(const Ray& ray) const -> Intersection override;
+	auto getIntersection(const Ray& ray, const HitRecord& hit) const -> Intersection override;
 
 	bool hasEmission() const override;
 	auto evalDiffuse(const vec2f_t& texcoords) const -> vec3f_t override;
@@ -0,0 +1,99 @@
+#include "RadianceCache.hpp"
+
+#include <bit>
+#include <iostream>
+
+void RadianceCache::reset(size_t new_capacity, float new_cell_size)
+{
+	capacity = new_capacity ? std::bit_ceil(new_capacity) : 0;
+	cells = capacity ? std::make_unique<Cell[]>(capacity) : nullptr;
+	cell_size = new_cell_size;
+	hits = misses = dropped = 0;
+}
+
+uint64_t RadianceCache::key(const vec3f_t& position, const vec3f_t& normal) const
+{
+	// 20 bits per axis of the cell coordinate, 3 bits for the normal's dominant axis and sign, and a set top bit
+	// so no key is zero
+	uint64_t result = 1ull << 63;
+	for (int axis = 0; axis < 3; axis++) {
+		int64_t cell = static_cast<int64_t>(std::floor(position[axis] / cell_size));
+		result |= (static_cast<uint64_t>(cell) & 0xFFFFF) << (20 * axis);
+	}
+
+	int dominant = 0;
+	normal.cwiseAbs().maxCoeff(&dominant);
+	result |= static_cast<uint64_t>(2 * dominant + (normal[dominant] < 0.f)) << 60;
+
+	return result;
+}
+
+RadianceCache::Cell* RadianceCache::find(uint64_t key, bool insert) const
+{
+	size_t index = (key * 0x9E3779B97F4A7C15ull) >> 32;
+	for (int probe = 0; probe < MAX_PROBES; probe++) {
+		Cell&    cell = cells[(index + probe) & (capacity - 1)];
+		uint64_t current = cell.key.load(std::memory_order_acquire);
+		if (current == key)
+			return &cell;
+		if (current != 0)
+			continue;
+		if (!insert)
+			return nullptr;
+
+		// a racing thread may claim the cell first, possibly for the same key
+		if (cell.key.compare_exchange_strong(current, key, std::memory_order_acq_rel) || current == key)
+			return &cell;
+	}
+
+	return nullptr;
+}
+
+void RadianceCache::add(const vec3f_t& position, const vec3f_t& normal, const vec3f_t& radiance)
+{
+	if (!enabled() || !radiance.allFinite())
+		return;
+
+	Cell* cell = find(key(position, normal), true);
+	if (!cell) {
+		dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	for (int c = 0; c < 3; c++)
+		cell->sum[c].fetch_add(radiance[c], std::memory_order_relaxed);
+	cell->count.fetch_add(1, std::memory_order_release);
+}
+
+bool RadianceCache::query(const vec3f_t& position, const vec3f_t& normal, vec3f_t& radiance)
+{
+	if (!enabled())
+		return false;
+
+	// sums and count are read without a lock, a concurrent add skews the mean by at most one sample
+	Cell*    cell = find(key(position, normal), false);
+	uint32_t count = cell ? cell->count.load(std::memory_order_acquire) : 0;
+	if (count < min_samples) {
+		misses.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	hits.fetch_add(1, std::memory_order_relaxed);
+	for (int c = 0; c < 3; c++)
+		radiance[c] = cell->sum[c].load(std::memory_order_relaxed) / count;
+
+	return true;
+}
+
+void RadianceCache::report()
+{
+	if (hits + misses == 0)
+		return;
+
+	size_t used = 0;
+	for (size_t i = 0; i < capacity; i++)
+		used += cells[i].key.load(std::memory_order_relaxed) != 0;
+
+	std::cout << "Radiance cache: " << hits << " hits, " << misses << " misses, " << dropped << " dropped samples, "
+	          << used << " / " << capacity << " cells" << std::endl;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <memory>
+
+#include "global.hpp"
+
+// outgoing radiance of diffuse surfaces averaged per cell of a spatial hash grid, keyed on the quantized position
+// and the dominant axis of the normal; every render thread adds and queries concurrently without locks
+class RadianceCache {
+private:
+	static constexpr int MAX_PROBES = 8;
+
+	// a zero key marks a free cell, a cell is claimed once and then only accumulates
+	struct Cell {
+		std::atomic<uint64_t>             key{0};
+		std::atomic<uint32_t>             count{0};
+		std::array<std::atomic<float>, 3> sum{};
+	};
+
+	std::unique_ptr<Cell[]> cells;
+	size_t                  capacity{0};
+
+	auto key(const vec3f_t& position, const vec3f_t& normal) const -> uint64_t;
+	auto find(uint64_t key, bool insert) const -> Cell*;
+
+public:
+	float cell_size{1.f};
+
+	// paths end at a cached cell from this depth on, once the cell has seen min_samples samples
+	int      query_depth{1};
+	uint32_t min_samples{16};
+
+	std::atomic<size_t> hits{0};
+	std::atomic<size_t> misses{0};
+	std::atomic<size_t> dropped{0};
+
+	// capacity is rounded up to a power of two, zero disables the cache
+	void reset(size_t capacity, float cell_size);
+	auto enabled() const -> bool { return capacity > 0; }
+
+	void add(const vec3f_t& position, const vec3f_t& normal, const vec3f_t& radiance);
+	bool query(const vec3f_t& position, const vec3f_t& normal, vec3f_t& radiance);
+	void report();
+};
@@ -10,7 +10,22 @@ struct Ray {
 	vec3f_t direction;
 	double  time;
 
+	// cone for texture filtering, its width at the origin and how much that grows per unit of distance
+	float cone_width{};
+	float cone_spread{};
+
 	vec3f_t at(double t) const;
+	auto    coneWidth(float t) const -> float { return cone_width + cone_spread * t; }
+};
+
+// minimal record kept during traversal, only the closest hit is expanded into an Intersection
+struct HitRecord {
+	float    t{std::numeric_limits<float>::max()};
+	uint32_t prim_id{std::numeric_limits<uint32_t>::max()};
+	float    u{};
+	float    v{};
+
+	bool hit() const { return prim_id != std::numeric_limits<uint32_t>::max(); }
 };
 
 struct Intersection {
@@ -19,8 +34,9 @@ struct Intersection {
 	vec2f_t texcoord;
 	vec3f_t emit;
 	float   distance{std::numeric_limits<float>::max()};
+	float   uv_density{};        // uv-space area per unit of surface area, zero where no texture is mapped
 
-	bool       hit{false};
-	Material*  material{nullptr};
-	Primitive* primitive{nullptr};
+	bool             hit{false};
+	Material*        material{nullptr};
+	const Primitive* primitive{nullptr};
 };
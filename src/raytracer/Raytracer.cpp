@@ -2,60 +2,151 @@
 
 #include <iostream>
 #include <fstream>
+#include <atomic>
 #include <thread>
 #include <mutex>
 
-void Raytracer::render(Scene& new_scene)
+#include "GBuffer.hpp"
+#include "GeometryCache.hpp"
+#include "Timeline.hpp"
+
+void Raytracer::setup(Scene& new_scene)
+{
+	setup(new_scene, new_scene.width, new_scene.height);
+}
+
+void Raytracer::setup(Scene& new_scene, int new_width, int new_height)
 {
 	this->scene = &new_scene;
-	framebuffer.resize(scene->width * scene->height, vec3f_t::Zero());
-	fov = 40.0f;
+	width = new_width;
+	height = new_height;
+	framebuffer.assign(width * height, vec3f_t::Zero());
+	heatmap.assign(TraceStats::enabled ? width * height : 0, 0.f);
+	first_hits.assign(static_cast<size_t>(width) * height * std::max(first_hit_patterns, 0), SurfaceHit{});
+	pixel_samples.assign(first_hits.empty() ? 0 : width * height, 0);
 	scale = std::tan(Geometry::radians(fov) / 2.0f);
-	aspect_ratio = static_cast<float>(scene->width) / static_cast<float>(scene->height);
-	camera_position = vec3f_t(278, 273, -800);
-
-	const int num_threads = std::thread::hardware_concurrency();
-
-	std::vector<std::thread> threads;
-	std::atomic<int>         completed_pixels{0};
-	std::mutex               progress_mutex;
+	aspect_ratio = static_cast<float>(width) / static_cast<float>(height);
+
+	vec3f_t forward = (camera_target - camera_position).normalized();
+	vec3f_t right = forward.cross(camera_up).normalized();
+	vec3f_t up = right.cross(forward);
+	camera_to_world << right, up, forward;
+
+	if (rasterize_first_hits && !first_hits.empty()) {
+		GBuffer gbuffer;
+		for (int p = 0; p < first_hit_patterns; p++) {
+			size_t traced = gbuffer.rasterize(*scene, *this, patternOffset(p), &first_hits[p], first_hit_patterns);
+			if (TraceStats::enabled)
+				stats.camera_rays += traced;
+		}
+	}
+}
 
-	auto render_rows = [&](int start_row, int end_row, int thread_id) {
-		std::random_device rd;
+void Raytracer::render(Scene& new_scene)
+{
+	TraceScope scope("render", "render");
+
+	setup(new_scene);
+
+	// with photon mapping every sample per pixel is a pass gathering from its own photon map; path guiding trains
+	// over passes of doubling sample counts, each sampling what the ones before learned; every pass is unbiased so
+	// all of them are kept
+	std::vector<vec3f_t> accumulation(width * height, vec3f_t::Zero());
+	if (scene->photons.enabled() || scene->guide.enabled()) {
+		for (int rendered = 0, pass_size = 1; rendered < samples_per_pixel;) {
+			int count = scene->photons.enabled() ? 1 : std::min(pass_size, samples_per_pixel - rendered);
+			if (scene->photons.enabled())
+				scene->photons.trace(*scene);
+
+			renderRegion(Tile{0, 0, width, height}, count, accumulation);
+			rendered += count;
+
+			if (scene->guide.enabled() && rendered == 2 * pass_size - 1) {
+				scene->guide.refine();
+				pass_size *= 2;
+			}
+		}
+	} else
+		renderRegion(Tile{0, 0, width, height}, samples_per_pixel, accumulation);
 
-		std::mt19937 gen(rd() + thread_id);
+	for (size_t i = 0; i < framebuffer.size(); i++)
+		framebuffer[i] = accumulation[i] / samples_per_pixel;
+}
 
-		std::uniform_real_distribution<float> dis(0.0f, 1.0f);
+void Raytracer::renderRegion(const Tile& region, int sample_count, std::vector<vec3f_t>& accumulation,
+                             const std::function<void(const Tile&)>& on_tile)
+{
+	const int num_threads = std::max(1u, std::thread::hardware_concurrency());
 
-		for (int j = start_row; j < end_row; j++) {
-			for (int i = 0; i < scene->width; i++) {
-				float   x = (2.f * ((i + 0.5f) / scene->width) - 1.f) * scale * aspect_ratio;
-				float   y = (1.f - 2.f * ((j + 0.5f) / scene->height)) * scale;
-				vec3f_t ray_direction = vec3f_t(-x, y, 1).normalized();
-				vec3f_t pixel_color = vec3f_t::Zero();
+	std::vector<Tile>        tiles = split(region, tile_size);
+	std::vector<std::thread> threads;
+	std::atomic<int>         next_tile{0};
+	std::atomic<int>         completed_tiles{0};
+	std::mutex               progress_mutex;
 
-				for (int k = 0; k < samples_per_pixel; k++) {
-					pixel_color += scene->castRay(Ray(camera_position, ray_direction), 0);
+	// accumulation holds the per-pixel sum of sample_count samples, laid out row-major over the region
+	auto render_tiles = [&]() {
+		for (int t = next_tile.fetch_add(1); t < static_cast<int>(tiles.size()); t = next_tile.fetch_add(1)) {
+			const Tile& tile = tiles[t];
+			TraceScope  scope("tile", "render", std::to_string(tile.x0) + "," + std::to_string(tile.y0));
+			PerfScope   counters(TraceStats::local().render_counters);
+
+			for (int j = tile.y0; j < tile.y1; j++) {
+				for (int i = tile.x0; i < tile.x1; i++) {
+					vec3f_t  pixel_color = vec3f_t::Zero();
+					uint64_t cost = TraceStats::enabled ? TraceStats::local().cost() : 0;
+
+					if (first_hits.empty()) {
+						Ray ray = cameraRay(i + 0.5f, j + 0.5f);
+						for (int k = 0; k < sample_count; k++)
+							pixel_color += scene->castRay(ray, 0);
+					} else {
+						// each pixel belongs to one tile, so only this thread touches its hits and count
+						size_t      pixel = static_cast<size_t>(j) * width + i;
+						SurfaceHit* hits = &first_hits[pixel * first_hit_patterns];
+						if (pixel_samples[pixel] == 0 && !rasterize_first_hits) {
+							for (int p = 0; p < first_hit_patterns; p++) {
+								vec2f_t offset = patternOffset(p);
+								scene->closestHit(cameraRay(i + offset.x(), j + offset.y()), hits[p]);
+								if (TraceStats::enabled)
+									TraceStats::local().camera_rays++;
+							}
+						}
+
+						for (int k = 0; k < sample_count; k++) {
+							int     p = (pixel_samples[pixel] + k) % first_hit_patterns;
+							vec2f_t offset = patternOffset(p);
+							Ray     ray = cameraRay(i + offset.x(), j + offset.y());
+							pixel_color += scene->shade(ray, scene->resolve(ray, hits[p]), 0);
+						}
+						pixel_samples[pixel] += sample_count;
+					}
+
+					accumulation[(j - region.y0) * region.width() + (i - region.x0)] += pixel_color;
+					if (!heatmap.empty())
+						heatmap[j * width + i] += static_cast<float>(TraceStats::local().cost() - cost);
 				}
+			}
 
-				int pixel_index = j * scene->width + i;
-				framebuffer[pixel_index] = pixel_color / samples_per_pixel;
+			if (on_tile)
+				on_tile(tile);
+			GeometryCache::unpin();
 
-				int current_completed = completed_pixels.fetch_add(1);
-				if (current_completed % 1000 == 0) {
-					std::lock_guard<std::mutex> lock(progress_mutex);
-					std::cout << "\rRendering: " << current_completed / 1000 << "k / " << (scene->width * scene->height) / 1000 << "k pixels" << std::flush;
-				}
-			}
+			int current_completed = completed_tiles.fetch_add(1) + 1;
+			std::lock_guard<std::mutex> lock(progress_mutex);
+			std::cout << "\rRendering: " << current_completed << " / " << tiles.size() << " tiles" << std::flush;
+		}
+
+		// each thread merges its counters once, after its last tile
+		if (TraceStats::enabled) {
+			std::lock_guard<std::mutex> lock(progress_mutex);
+			stats.merge(TraceStats::local());
+			TraceStats::local() = TraceStats{};
 		}
 	};
 
-	int rows_per_thread = scene->height / num_threads;
-	for (int t = 0; t < num_threads; t++) {
-		int start_row = t * rows_per_thread;
-		int end_row = (t == num_threads - 1) ? scene->height : (t + 1) * rows_per_thread;
-		threads.emplace_back(render_rows, start_row, end_row, t);
-	}
+	for (int t = 0; t < num_threads; t++)
+		threads.emplace_back(render_tiles);
 
 	for (auto& thread : threads)
 		thread.join();
@@ -63,8 +154,48 @@ void Raytracer::render(Scene& new_scene)
 	std::cout << std::endl;
 }
 
+Ray Raytracer::cameraRay(float x, float y) const
+{
+	float ndc_x = (2.f * (x / width) - 1.f) * scale * aspect_ratio;
+	float ndc_y = (1.f - 2.f * (y / height)) * scale;
+
+	// a pixel's cone starts at the eye and widens by its angle, the one the vertical field of view spreads over a row
+	Ray ray(camera_position, (camera_to_world * vec3f_t(ndc_x, ndc_y, 1)).normalized());
+	ray.cone_spread = 2.f * scale / height;
+
+	return ray;
+}
+
+vec2f_t Raytracer::patternOffset(int pattern) const
+{
+	if (first_hit_patterns <= 1)
+		return vec2f_t(0.5f, 0.5f);
+
+	// hammersley points, the same set in every pixel
+	uint32_t bits = static_cast<uint32_t>(pattern);
+	bits = (bits << 16u) | (bits >> 16u);
+	bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+	bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+	bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+	bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+
+	return vec2f_t((pattern + 0.5f) / first_hit_patterns, static_cast<float>(bits) * 2.3283064365386963e-10f);
+}
+
+std::vector<Tile> Raytracer::split(const Tile& region, int tile_size)
+{
+	std::vector<Tile> tiles;
+	for (int y = region.y0; y < region.y1; y += tile_size)
+		for (int x = region.x0; x < region.x1; x += tile_size)
+			tiles.push_back(Tile{x, y, std::min(x + tile_size, region.x1), std::min(y + tile_size, region.y1)});
+
+	return tiles;
+}
+
 void Raytracer::save(const std::string& filename)
 {
+	TraceScope scope("save", "output", filename);
+
 	constexpr float GAMMA = .6f;
 
 	std::ofstream file(filename, std::ios::binary);
@@ -72,7 +203,7 @@ void Raytracer::save(const std::string& filename)
 		throw std::runtime_error("Failed to open file for saving: " + filename);
 
 	file << "P6\n"
-	     << scene->width << " " << scene->height << "\n255\n";
+	     << width << " " << height << "\n255\n";
 	for (const auto& color : framebuffer) {
 		unsigned char r = static_cast<unsigned char>(255.f * std::pow(std::clamp(color.x(), 0.f, 1.f), GAMMA));
 		unsigned char g = static_cast<unsigned char>(255.f * std::pow(std::clamp(color.y(), 0.f, 1.f), GAMMA));
@@ -84,3 +215,29 @@ void Raytracer::save(const std::string& filename)
 
 	file.close();
 }
+
+void Raytracer::saveHeatmap(const std::string& filename)
+{
+	std::ofstream file(filename, std::ios::binary);
+	if (!file.is_open())
+		throw std::runtime_error("Failed to open file for saving: " + filename);
+
+	float max_cost = 0.f;
+	for (float cost : heatmap)
+		max_cost = std::max(max_cost, cost);
+
+	// blue through green to red, relative to the most expensive pixel
+	file << "P6\n"
+	     << width << " " << height << "\n255\n";
+	for (float cost : heatmap) {
+		float         t = max_cost > 0.f ? cost / max_cost : 0.f;
+		unsigned char r = static_cast<unsigned char>(255.f * std::clamp(1.5f - std::abs(4.f * t - 3.f), 0.f, 1.f));
+		unsigned char g = static_cast<unsigned char>(255.f * std::clamp(1.5f - std::abs(4.f * t - 2.f), 0.f, 1.f));
+		unsigned char b = static_cast<unsigned char>(255.f * std::clamp(1.5f - std::abs(4.f * t - 1.f), 0.f, 1.f));
+		file.write(reinterpret_cast<const char*>(&r), sizeof(r));
+		file.write(reinterpret_cast<const char*>(&g), sizeof(g));
+		file.write(reinterpret_cast<const char*>(&b), sizeof(b));
+	}
+
+	file.close();
+}
@@ -1,22 +1,61 @@
 #pragma once
 
+#include <functional>
+
 #include "Scene.hpp"
 
+struct Tile {
+	int x0, y0;
+	int x1, y1;
+
+	int width() const { return x1 - x0; }
+	int height() const { return y1 - y0; }
+};
+
 class Raytracer {
 public:
 	Scene* scene;
 
+	int width{};
+	int height{};
 	int samples_per_pixel{16};
+	int tile_size{16};
 
-	float fov;
+	float fov{40.0f};
 	float scale;
 	float aspect_ratio;
 
-	vec3f_t background_color;
-	vec3f_t camera_position;
+	vec3f_t camera_position{278, 273, -800};
+	vec3f_t camera_target{278, 273, 0};
+	vec3f_t camera_up{0, 1, 0};
+	mat3f_t camera_to_world;
 
 	std::vector<vec3f_t> framebuffer;
 
+	// primary hits at first_hit_patterns fixed positions per pixel, traced on the pixel's first sample and shaded by
+	// every later one until the next setup; more than one pattern jitters the positions, zero disables the cache
+	int                     first_hit_patterns{1};
+	std::vector<SurfaceHit> first_hits;
+	std::vector<uint32_t>   pixel_samples;
+
+	// fills the first hits by rasterizing the scene at setup instead of tracing them on each pixel's first sample
+	bool rasterize_first_hits{false};
+
+	// merged from the render threads, heatmap sums the box and primitive tests of each pixel's samples
+	TraceStats         stats;
+	std::vector<float> heatmap;
+
+	void setup(Scene& new_scene);
+	// renders at its own resolution, leaving the scene's as it is for whoever else renders it
+	void setup(Scene& new_scene, int new_width, int new_height);
 	void render(Scene& new_scene);
+	void renderRegion(const Tile& region, int sample_count, std::vector<vec3f_t>& accumulation,
+	                  const std::function<void(const Tile&)>& on_tile = nullptr);
 	void save(const std::string& filename);
+	void saveHeatmap(const std::string& filename);
+
+	auto cameraRay(float x, float y) const -> Ray;
+	auto patternOffset(int pattern) const -> vec2f_t;
+
+	static auto split(const Tile& region, int tile_size) -> std::vector<Tile>;
 };
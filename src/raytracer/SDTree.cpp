@@ -0,0 +1,268 @@
+#include "SDTree.hpp"
+
+#include <functional>
+#include <iostream>
+
+DTree::Node::Node(const Node& other) :
+    child(other.child)
+{
+	for (int i = 0; i < 4; i++)
+		sum[i].store(other.sum[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+DTree::Node& DTree::Node::operator=(const Node& other)
+{
+	child = other.child;
+	for (int i = 0; i < 4; i++)
+		sum[i].store(other.sum[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+	return *this;
+}
+
+DTree::DTree(const DTree& other) :
+    nodes(other.nodes),
+    samples(other.samples.load())
+{
+}
+
+DTree& DTree::operator=(const DTree& other)
+{
+	nodes = other.nodes;
+	samples = other.samples.load();
+
+	return *this;
+}
+
+float DTree::total() const
+{
+	float result = 0.f;
+	for (const auto& sum : nodes[0].sum)
+		result += sum.load(std::memory_order_relaxed);
+
+	return result;
+}
+
+void DTree::record(vec2f_t point, float value)
+{
+	samples.fetch_add(1, std::memory_order_relaxed);
+	if (!(value > 0.f) || !std::isfinite(value))
+		return;
+
+	for (uint32_t node = 0;;) {
+		int qx = point.x() >= .5f, qy = point.y() >= .5f;
+		int quadrant = qx + 2 * qy;
+		nodes[node].sum[quadrant].fetch_add(value, std::memory_order_relaxed);
+		if (!nodes[node].child[quadrant])
+			return;
+
+		node = nodes[node].child[quadrant];
+		point = vec2f_t(2.f * point.x() - qx, 2.f * point.y() - qy);
+	}
+}
+
+float DTree::pdf(vec2f_t point) const
+{
+	// density over the unit square, an empty tree is uniform
+	if (!(total() > 0.f))
+		return 1.f;
+
+	float density = 1.f;
+	for (uint32_t node = 0;;) {
+		int   qx = point.x() >= .5f, qy = point.y() >= .5f;
+		int   quadrant = qx + 2 * qy;
+		float sum = 0.f;
+		for (const auto& s : nodes[node].sum)
+			sum += s.load(std::memory_order_relaxed);
+		if (!(sum > 0.f))
+			return 0.f;
+
+		density *= 4.f * nodes[node].sum[quadrant].load(std::memory_order_relaxed) / sum;
+		if (!nodes[node].child[quadrant])
+			return density;
+
+		node = nodes[node].child[quadrant];
+		point = vec2f_t(2.f * point.x() - qx, 2.f * point.y() - qy);
+	}
+}
+
+vec2f_t DTree::sample(vec2f_t random) const
+{
+	if (!(total() > 0.f))
+		return random;
+
+	// picks the column then the row in proportion to their energy, reusing the rescaled random numbers below
+	constexpr float ONE_MINUS_EPSILON = 0.99999994f;
+
+	vec2f_t origin(0.f, 0.f);
+	float   size = 1.f;
+	for (uint32_t node = 0;;) {
+		std::array<float, 4> sum;
+		for (int i = 0; i < 4; i++)
+			sum[i] = nodes[node].sum[i].load(std::memory_order_relaxed);
+
+		float left = (sum[0] + sum[2]) / (sum[0] + sum[1] + sum[2] + sum[3]);
+		int   qx = random.x() < left ? 0 : 1;
+		random.x() = std::min(qx ? (random.x() - left) / (1.f - left) : random.x() / left, ONE_MINUS_EPSILON);
+
+		float bottom = sum[qx] / (sum[qx] + sum[qx + 2]);
+		int   qy = random.y() < bottom ? 0 : 1;
+		random.y() = std::min(qy ? (random.y() - bottom) / (1.f - bottom) : random.y() / bottom, ONE_MINUS_EPSILON);
+
+		int quadrant = qx + 2 * qy;
+		size *= .5f;
+		origin += vec2f_t(qx * size, qy * size);
+		if (!nodes[node].child[quadrant])
+			return origin + random * size;
+
+		node = nodes[node].child[quadrant];
+	}
+}
+
+void DTree::refine(const DTree& source, float threshold)
+{
+	nodes.assign(1, Node{});
+	samples = 0;
+
+	float total = source.total();
+	if (!(total > 0.f))
+		return;
+
+	// quadrants the source never subdivided split their energy evenly among the new children
+	std::function<void(uint32_t, int, const std::array<float, 4>&, int)> subdivide =
+	    [&](uint32_t target, int from, const std::array<float, 4>& energy, int depth) {
+		    for (int i = 0; i < 4; i++) {
+			    if (depth >= MAX_DEPTH || energy[i] / total <= threshold)
+				    continue;
+
+			    int                  from_child = from >= 0 && source.nodes[from].child[i] ? source.nodes[from].child[i] : -1;
+			    std::array<float, 4> child_energy;
+			    for (int j = 0; j < 4; j++)
+				    child_energy[j] = from_child >= 0 ? source.nodes[from_child].sum[j].load(std::memory_order_relaxed) : energy[i] / 4.f;
+
+			    uint32_t child = static_cast<uint32_t>(nodes.size());
+			    nodes.emplace_back();
+			    nodes[target].child[i] = child;
+			    subdivide(child, from_child, child_energy, depth + 1);
+		    }
+	    };
+
+	std::array<float, 4> energy;
+	for (int i = 0; i < 4; i++)
+		energy[i] = source.nodes[0].sum[i].load(std::memory_order_relaxed);
+	subdivide(0, 0, energy, 1);
+}
+
+vec2f_t DTree::toSquare(const vec3f_t& direction)
+{
+	float phi = std::atan2(direction.y(), direction.x());
+	if (phi < 0.f)
+		phi += 2.f * PI;
+
+	return vec2f_t(std::clamp((direction.z() + 1.f) / 2.f, 0.f, 1.f), std::clamp(phi / (2.f * PI), 0.f, 1.f));
+}
+
+vec3f_t DTree::toSphere(const vec2f_t& point)
+{
+	float cos_theta = 2.f * point.x() - 1.f;
+	float sin_theta = std::sqrt(std::max(0.f, 1.f - cos_theta * cos_theta));
+	float phi = 2.f * PI * point.y();
+
+	return vec3f_t(sin_theta * std::cos(phi), sin_theta * std::sin(phi), cos_theta);
+}
+
+void SDTree::reset(const Bound& scene_bound)
+{
+	// a cube around the scene, so halving along alternating axes keeps the cells close to cubes
+	vec3f_t center = scene_bound.centroid();
+	float   extent = scene_bound.diagonal().maxCoeff() * .5f * 1.001f;
+	bound = Bound(center - vec3f_t::Constant(extent), center + vec3f_t::Constant(extent));
+
+	nodes.assign(1, SpatialNode{});
+	iteration = 0;
+}
+
+uint32_t SDTree::leaf(const vec3f_t& position) const
+{
+	vec3f_t point = bound.offset(position).cwiseMax(0.f).cwiseMin(1.f);
+
+	uint32_t node = 0;
+	while (nodes[node].child[0]) {
+		int axis = nodes[node].axis;
+		int side = point[axis] >= .5f;
+		point[axis] = 2.f * point[axis] - side;
+		node = nodes[node].child[side];
+	}
+
+	return node;
+}
+
+vec3f_t SDTree::sample(const vec3f_t& position) const
+{
+	const DTree& tree = nodes[leaf(position)].sampling;
+	return DTree::toSphere(tree.sample(vec2f_t(Geometry::randomFloat(), Geometry::randomFloat())));
+}
+
+float SDTree::pdf(const vec3f_t& position, const vec3f_t& direction) const
+{
+	// the mapping to the square preserves area, the sphere's 4 pi steradians become its unit area
+	return nodes[leaf(position)].sampling.pdf(DTree::toSquare(direction)) / (4.f * PI);
+}
+
+void SDTree::record(const vec3f_t& position, const vec3f_t& direction, float radiance)
+{
+	nodes[leaf(position)].building.record(DTree::toSquare(direction), radiance);
+}
+
+void SDTree::split(uint32_t node, uint32_t threshold)
+{
+	if (nodes[node].building.samples <= threshold)
+		return;
+
+	// children start from copies of the parent's distributions, each credited with half its samples
+	int      axis = nodes[node].axis;
+	uint32_t first = static_cast<uint32_t>(nodes.size());
+	for (int side = 0; side < 2; side++) {
+		SpatialNode child;
+		child.axis = (axis + 1) % 3;
+		child.sampling = nodes[node].sampling;
+		child.building = nodes[node].building;
+		child.building.samples = nodes[node].building.samples / 2;
+		nodes.push_back(std::move(child));
+	}
+	nodes[node].child = {first, first + 1};
+	nodes[node].sampling = DTree{};
+	nodes[node].building = DTree{};
+
+	split(first, threshold);
+	split(first + 1, threshold);
+}
+
+void SDTree::refine()
+{
+	iteration++;
+
+	uint32_t threshold = static_cast<uint32_t>(spatial_threshold * std::sqrt(std::pow(2.f, iteration - 1)));
+	for (uint32_t node = 0, count = static_cast<uint32_t>(nodes.size()); node < count; node++)
+		if (!nodes[node].child[0])
+			split(node, threshold);
+
+	for (auto& node : nodes) {
+		if (node.child[0])
+			continue;
+
+		node.sampling = node.building;
+		node.building.refine(node.sampling, directional_threshold);
+	}
+}
+
+void SDTree::report() const
+{
+	if (!trained())
+		return;
+
+	size_t leaves = 0;
+	for (const auto& node : nodes)
+		leaves += !node.child[0];
+
+	std::cout << "Path guiding: " << iteration << " training passes, " << leaves << " spatial leaves" << std::endl;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <vector>
+
+#include "Bound.hpp"
+
+// distribution of incident radiance over the sphere of directions, a quadtree over the square that the cylindrical
+// mapping (cos theta, phi) takes the sphere to with equal areas; sums are atomic so all render threads record
+class DTree {
+private:
+	static constexpr int MAX_DEPTH = 20;
+
+	// child 0 marks a leaf quadrant, the root is never a child
+	struct Node {
+		std::array<std::atomic<float>, 4> sum{};
+		std::array<uint32_t, 4>           child{};
+
+		Node() = default;
+		Node(const Node& other);
+		Node& operator=(const Node& other);
+	};
+
+	std::vector<Node> nodes{1};
+
+public:
+	std::atomic<uint32_t> samples{0};
+
+	DTree() = default;
+	DTree(const DTree& other);
+	DTree& operator=(const DTree& other);
+
+	auto total() const -> float;
+	void record(vec2f_t point, float value);
+	auto pdf(vec2f_t point) const -> float;
+	auto sample(vec2f_t random) const -> vec2f_t;
+
+	// the structure of source refined where a quadrant holds more than threshold of its energy, with empty sums
+	void refine(const DTree& source, float threshold);
+
+	static auto toSquare(const vec3f_t& direction) -> vec2f_t;
+	static auto toSphere(const vec2f_t& point) -> vec3f_t;
+};
+
+// spatial binary tree over the scene whose leaves learn directional distributions over successive render passes;
+// paths sample the distribution of the previous pass and record into the one of the current
+class SDTree {
+private:
+	// child[0] 0 marks a leaf, leaves split halfway along axis
+	struct SpatialNode {
+		int                     axis{0};
+		std::array<uint32_t, 2> child{};
+		DTree                   sampling;
+		DTree                   building;
+	};
+
+	std::vector<SpatialNode> nodes;
+	Bound                    bound;
+	int                      iteration{0};
+
+	auto leaf(const vec3f_t& position) const -> uint32_t;
+	void split(uint32_t node, uint32_t threshold);
+
+public:
+	// fraction of directions still sampled from the bsdf, and the samples a leaf collects in a pass before it splits,
+	// scaled by the square root of the pass's sample count
+	float    bsdf_fraction{0.5f};
+	uint32_t spatial_threshold{4000};
+	float    directional_threshold{0.01f};
+
+	auto enabled() const -> bool { return !nodes.empty(); }
+	auto trained() const -> bool { return iteration > 0; }
+
+	void reset(const Bound& scene_bound);
+	auto sample(const vec3f_t& position) const -> vec3f_t;
+	auto pdf(const vec3f_t& position, const vec3f_t& direction) const -> float;
+	void record(const vec3f_t& position, const vec3f_t& direction, float radiance);
+
+	// called between passes, turns the recorded distributions into the sampled ones
+	void refine();
+	void report() const;
+};
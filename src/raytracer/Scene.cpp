@@ -1,18 +1,57 @@
 #include "Scene.hpp"
 
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+#include "Model.hpp"
+#include "ThreadPool.hpp"
+#include "Timeline.hpp"
+
 Scene::~Scene()
 {
 	delete bvh;
 	bvh = nullptr;
 	for (auto* light : lights)
 		delete light;
-	for (auto* primitive : primitives)
-		delete primitive;
+	for (auto* model : models)
+		delete model;
+	for (auto* material : materials)
+		delete material;
 }
 
 void Scene::add(Primitive* primitive)
 {
-	primitives.push_back(primitive);
+	if (auto* model = dynamic_cast<Model*>(primitive))
+		return add(model);
+
+	if (auto* triangle = dynamic_cast<Triangle*>(primitive))
+		add(*triangle);
+	else if (auto* sphere = dynamic_cast<Sphere*>(primitive))
+		add(*sphere);
+	else
+		throw std::runtime_error("Unsupported primitive type");
+
+	delete primitive;
+}
+
+void Scene::add(const Triangle& triangle)
+{
+	refs.push_back({PrimitiveType::TRIANGLE, static_cast<uint32_t>(triangles.size())});
+	triangles.push_back(triangle);
+}
+
+void Scene::add(const Sphere& sphere)
+{
+	refs.push_back({PrimitiveType::SPHERE, static_cast<uint32_t>(spheres.size())});
+	spheres.push_back(sphere);
+}
+
+void Scene::add(Model* model)
+{
+	refs.push_back({PrimitiveType::MODEL, static_cast<uint32_t>(models.size())});
+	models.push_back(model);
 }
 
 void Scene::add(Light* light)
@@ -20,104 +59,371 @@ void Scene::add(Light* light)
 	lights.push_back(light);
 }
 
+void Scene::add(Material* material)
+{
+	materials.push_back(material);
+}
+
+void Scene::load(const std::string& filepath)
+{
+	TraceScope scope("scene load", "scene", filepath);
+
+	std::ifstream file(filepath);
+	if (!file.is_open())
+		throw std::runtime_error("Failed to open scene: " + filepath);
+
+	auto directory = std::filesystem::path(filepath).parent_path();
+	auto resolve = [&](const std::string& path) {
+		auto resolved = std::filesystem::path(path);
+		if (resolved.is_relative())
+			resolved = directory / resolved;
+		if (!std::filesystem::exists(resolved))
+			throw std::runtime_error("Missing asset referenced by " + filepath + ": " + resolved.string());
+		return resolved.generic_string();
+	};
+
+	std::unordered_map<std::string, Material*> named_materials;
+	auto find = [&](const std::string& name) -> Material* {
+		if (name.empty())
+			return nullptr;
+		auto it = named_materials.find(name);
+		if (it == named_materials.end())
+			throw std::runtime_error("Unknown material in " + filepath + ": " + name);
+		return it->second;
+	};
+
+	// models load concurrently on the loader pool and join the scene in file order
+	auto&                            pool = ThreadPool::instance();
+	std::vector<std::future<Model*>> pending_models;
+
+	try {
+		std::string line;
+		for (int line_number = 1; std::getline(file, line); line_number++) {
+			std::istringstream stream(line);
+			std::string        keyword;
+			if (!(stream >> keyword) || keyword[0] == '#')
+				continue;
+
+			auto malformed = [&](const std::string& what) {
+				return std::runtime_error(filepath + ":" + std::to_string(line_number) + ": " + what);
+			};
+			auto read = [&](vec3f_t& v) {
+				if (!(stream >> v.x() >> v.y() >> v.z()))
+					throw malformed("expected three numbers after " + keyword);
+			};
+
+			if (keyword == "size") {
+				if (!(stream >> width >> height))
+					throw malformed("expected width and height");
+			} else if (keyword == "depth") {
+				if (!(stream >> max_depth))
+					throw malformed("expected max depth");
+			} else if (keyword == "material") {
+				auto* material = new Material{vec3f_t::Zero(), vec3f_t::Zero(), 1.f, vec3f_t::Zero(), 10.f};
+				add(material);
+
+				std::string name, property;
+				if (!(stream >> name))
+					throw malformed("expected material name");
+				named_materials[name] = material;
+				while (stream >> property) {
+					if (property == "kd")
+						read(material->kd);
+					else if (property == "ks")
+						read(material->ks);
+					else if (property == "emission")
+						read(material->emission);
+					else if (property == "ior" && (stream >> material->ior))
+						continue;
+					else if (property == "dielectric")
+						material->type = MaterialType::DIELECTRIC;
+					else if (property == "shininess" && (stream >> material->specular_exponent))
+						continue;
+					else
+						throw malformed("bad material property " + property);
+				}
+			} else if (keyword == "model") {
+				std::string path, material;
+				if (!(stream >> path))
+					throw malformed("expected model path");
+				stream >> material;
+				pending_models.push_back(Model::load(resolve(path), find(material), bvh_options));
+			} else if (keyword == "environment") {
+				std::string path;
+				if (!(stream >> path))
+					throw malformed("expected environment map path");
+				stream >> environment.scale;
+				environment.load(resolve(path));
+			} else if (keyword == "background") {
+				vec3f_t radiance;
+				read(radiance);
+				environment.setConstant(radiance);
+			} else if (keyword == "sphere") {
+				Sphere      sphere;
+				std::string material;
+				read(sphere.center);
+				if (!(stream >> sphere.radius))
+					throw malformed("expected sphere radius");
+				stream >> material;
+				sphere.material = find(material);
+				add(sphere);
+			} else {
+				throw malformed("unknown keyword " + keyword);
+			}
+		}
+	} catch (...) {
+		for (auto& model : pending_models)
+			delete pool.wait(model);
+		throw;
+	}
+
+	for (auto& model : pending_models)
+		add(pool.wait(model));
+
+	buildBVH();
+}
+
 const std::vector<Light*>& Scene::getLights() const
 {
 	return lights;
 }
 
-const std::vector<Primitive*>& Scene::getPrimitives() const
+void Scene::buildBVH()
 {
-	return primitives;
+	TraceScope scope("scene bvh build", "bvh");
+
+	std::vector<Bound> bounds;
+	std::vector<float> areas;
+
+	emitters.clear();
+	emitter_areas.clear();
+	emit_area_sum = 0;
+	for (const auto& ref : refs) {
+		visit(ref, [&](const auto& primitive) {
+			bounds.push_back(primitive.bound());
+			areas.push_back(primitive.area());
+
+			if (primitive.hasEmission()) {
+				emitters.push_back(ref);
+				emitter_areas.push_back(primitive.area());
+				emit_area_sum += primitive.area();
+			}
+		});
+	}
+
+	delete bvh;
+	BVHBuildOptions scene_options = bvh_options;
+	scene_options.max_primitives_per_leaf = 1;
+	bvh = new BVHAccel(bounds, areas, scene_options);
+
+	// model hierarchies are otherwise built together here, lazily only the ones rays reach are;
+	// with the geometry cache enabled models not streamed while loading are streamed now
+	auto&                          pool = ThreadPool::instance();
+	std::vector<std::future<void>> builds;
+	for (auto* model : models) {
+		if (model->streamed())
+			continue;
+
+		model->bvh_options = bvh_options;
+		if (GeometryCache::instance().enabled())
+			builds.push_back(pool.submit([model]() { model->stream(); }));
+		else if (!bvh_options.lazy)
+			builds.push_back(pool.submit([model]() { model->accel(); }));
+	}
+	for (auto& build : builds)
+		pool.wait(build);
 }
 
-void Scene::buildBVH()
+bool Scene::closestHit(const Ray& ray, SurfaceHit& hit) const
 {
-	bvh = new BVHAccel(primitives, 1, BVHBuildMethod::NAIVE);
+	PerfScope counters(TraceStats::local().traversal_counters);
+
+	// traversal only tracks the closest record, the surface is resolved separately
+	auto intersect_primitive = [&](uint32_t id, HitRecord& closest) {
+		if (!visit(refs[id], [&](const auto& primitive) { return primitive.intersect(ray, closest); }))
+			return false;
+		hit.ref = id;
+		return true;
+	};
+
+	hit.record = HitRecord{};
+	if (bvh->intersect(ray, hit.record, intersect_primitive))
+		return true;
+
+	hit.record = HitRecord{};
+	return false;
+}
+
+Intersection Scene::resolve(const Ray& ray, const SurfaceHit& hit) const
+{
+	if (!hit.record.hit())
+		return Intersection{};
+
+	return visit(refs[hit.ref], [&](const auto& primitive) { return primitive.getIntersection(ray, hit.record); });
 }
 
 Intersection Scene::intersect(const Ray& ray) const
 {
-	return bvh->intersect(ray);
+	SurfaceHit hit;
+	if (!closestHit(ray, hit))
+		return Intersection{};
+
+	return resolve(ray, hit);
 }
 
 void Scene::sampleLight(Intersection& pos, float& pdf) const
 {
-	float emit_area_sum = 0;
-	for (const auto& p : primitives)
-		if (p->hasEmission())
-			emit_area_sum += p->area();
-
 	float a = Geometry::randomFloat() * emit_area_sum;
-	emit_area_sum = 0;
-	for (const auto& p : primitives) {
-		if (p->hasEmission()) {
-			emit_area_sum += p->area();
-			if (a <= emit_area_sum) {
-				p->sample(pos, pdf);
-				break;
-			}
+	for (size_t i = 0; i < emitters.size(); i++) {
+		if (a <= emitter_areas[i] || i + 1 == emitters.size()) {
+			visit(emitters[i], [&](const auto& primitive) { primitive.sample(pos, pdf); });
+			// account for picking this emitter among all of them by area
+			pdf *= emitter_areas[i] / emit_area_sum;
+			break;
 		}
+		a -= emitter_areas[i];
 	}
 }
 
-vec3f_t Scene::castRay(const Ray& ray, int depth) const
+vec3f_t Scene::castRay(const Ray& ray, int depth, bool after_diffuse) const
+{
+	// max depth check
+	if (depth >= max_depth)
+		return vec3f_t::Zero();
+
+	// hit check, every ray is counted once where it is traced
+	Intersection hit_point = intersect(ray);
+	if (TraceStats::enabled)
+		(depth == 0 ? TraceStats::local().camera_rays : TraceStats::local().bounce_rays)++;
+
+	return shade(ray, hit_point, depth, after_diffuse);
+}
+
+vec3f_t Scene::shade(const Ray& ray, const Intersection& hit_point, int depth, bool after_diffuse) const
 {
 	constexpr float EPSILON = 0.0001f;
-	static int      cnt = 0;
 
 	vec3f_t direct_lighting = vec3f_t::Zero();
 	vec3f_t indirect_lighting = vec3f_t::Zero();
 
-	// max depth check
 	if (depth >= max_depth)
 		return vec3f_t::Zero();
 
-	// hit check
-	Intersection hit_point = intersect(ray);
+	// counters are only gathered when stats are enabled
+	TraceStats* stats = TraceStats::enabled ? &TraceStats::local() : nullptr;
+
+	// only camera rays and dielectric chains get here when escaping, diffuse bounces are lit by sampling the environment
 	if (!hit_point.hit)
-		return vec3f_t::Zero();
+		return environment.eval(ray.direction);
+	if (stats)
+		stats->path_depths[std::min(depth, TraceStats::MAX_PATH_LENGTH - 1)]++;
 
 	// material check
 	if (!hit_point.material)
 		return vec3f_t::Zero();
 
-	// emission check
+	// emission check, light reaching a diffuse surface through dielectrics is gathered from photons once traced
 	if (hit_point.material->hasEmission())
-		return hit_point.material->emission;
+		return after_diffuse && photons.ready() ? vec3f_t::Zero() : hit_point.material->emission;
+
+	// the cone's cross section projected onto the surface and mapped into uv space selects the mip level; rays
+	// leaving the hit continue the cone, diffuse bounces without widening it, so they filter less than they could
+	vec3f_t surface_normal = hit_point.normal.normalized();
+	float   cone_width = ray.coneWidth(hit_point.distance);
+	float   footprint = hit_point.uv_density * cone_width * cone_width / std::max(std::abs(ray.direction.dot(surface_normal)), 1e-2f);
+
+	// dielectrics continue the path in the reflected or refracted direction with full weight
+	if (hit_point.material->type == MaterialType::DIELECTRIC) {
+		constexpr float OFFSET = 1e-3f;
+
+		vec3f_t specular_direction = hit_point.material->sample(ray.direction, surface_normal).normalized();
+		Ray     specular_ray(hit_point.position + surface_normal * (specular_direction.dot(surface_normal) > 0.f ? OFFSET : -OFFSET), specular_direction);
+		specular_ray.cone_width = cone_width;
+		specular_ray.cone_spread = ray.cone_spread;
+
+		return castRay(specular_ray, depth + 1, after_diffuse);
+	}
 
-	// direct lighting
-	Intersection light_sample{};
-	float        light_pdf{};
-	sampleLight(light_sample, light_pdf);
+	// past the query depth a cell with enough samples stands in for the rest of the path
+	vec3f_t cached_radiance;
+	if (depth >= radiance_cache.query_depth && radiance_cache.query(hit_point.position, surface_normal, cached_radiance))
+		return cached_radiance;
 
+	// direct lighting from one emitter sample or, with an environment, from one of the two picked evenly
 	vec3f_t hit_position = hit_point.position;
-	vec3f_t light_position = light_sample.position;
-	vec3f_t light_direction = (light_position - hit_position).normalized();
-	float   light_distance = (light_position - hit_position).norm();
-	vec3f_t surface_normal = hit_point.normal.normalized();
-	vec3f_t light_normal = light_sample.normal.normalized();
-	vec3f_t light_emission = light_sample.emit;
-
-	Ray          direct_ray(hit_position, light_direction);
-	Intersection direct_hit = intersect(direct_ray);
-	if (direct_hit.distance - light_distance > -EPSILON) {
-		vec3f_t direct_brdf = hit_point.material->eval(ray.direction, direct_ray.direction, surface_normal);
-		direct_lighting = light_emission.cwiseProduct(direct_brdf) * direct_ray.direction.dot(surface_normal) * (-direct_ray.direction).dot(light_normal) / (std::pow(light_distance, 2)) / light_pdf;
+	float   environment_probability = environment.enabled() ? (emitters.empty() ? 1.f : .5f) : 0.f;
+	if (Geometry::randomFloat() < environment_probability) {
+		vec3f_t environment_direction;
+		float   environment_pdf;
+		vec3f_t environment_radiance = environment.sample(environment_direction, environment_pdf);
+		float   cos_theta = environment_direction.dot(surface_normal);
+		if (environment_pdf > 0.f && cos_theta > 0.f) {
+			Ray direct_ray(hit_position, environment_direction);
+			if (stats)
+				stats->shadow_rays++;
+			if (!intersect(direct_ray).hit) {
+				vec3f_t direct_brdf = hit_point.material->eval(ray.direction, environment_direction, surface_normal, hit_point.texcoord, footprint);
+				direct_lighting = environment_radiance.cwiseProduct(direct_brdf) * cos_theta / environment_pdf / environment_probability;
+			}
+		}
+	} else if (!emitters.empty()) {
+		Intersection light_sample{};
+		float        light_pdf{};
+		sampleLight(light_sample, light_pdf);
+		light_pdf *= 1.f - environment_probability;
+
+		vec3f_t light_position = light_sample.position;
+		vec3f_t light_direction = (light_position - hit_position).normalized();
+		float   light_distance = (light_position - hit_position).norm();
+		vec3f_t light_normal = light_sample.normal.normalized();
+		vec3f_t light_emission = light_sample.emit;
+
+		Ray          direct_ray(hit_position, light_direction);
+		Intersection direct_hit = intersect(direct_ray);
+		if (stats)
+			stats->shadow_rays++;
+		if (direct_hit.distance - light_distance > -EPSILON) {
+			vec3f_t direct_brdf = hit_point.material->eval(ray.direction, direct_ray.direction, surface_normal, hit_point.texcoord, footprint);
+			direct_lighting = light_emission.cwiseProduct(direct_brdf) * direct_ray.direction.dot(surface_normal) * (-direct_ray.direction).dot(light_normal) / (std::pow(light_distance, 2)) / light_pdf;
+		}
 	}
 
-	if (Geometry::randomFloat() > russian_roulette)
-		return direct_lighting;
+	if (photons.ready())
+		direct_lighting += photons.gather(hit_position, surface_normal, hit_point.material->albedo(hit_point.texcoord, footprint) / PI);
+
+	if (Geometry::randomFloat() <= russian_roulette) {
+		// once the guide is trained directions come from the bsdf or the guide, weighted by the pdf of the mixture
+		bool    guided = guide.trained();
+		vec3f_t indirect_direction = guided && Geometry::randomFloat() >= guide.bsdf_fraction
+		                                 ? guide.sample(hit_position)
+		                                 : hit_point.material->sample(ray.direction, surface_normal).normalized();
+		float   pdf = hit_point.material->pdf(ray.direction, indirect_direction, surface_normal);
+		if (guided)
+			pdf = guide.bsdf_fraction * pdf + (1.f - guide.bsdf_fraction) * guide.pdf(hit_position, indirect_direction);
 
-	vec3f_t      indirect_direction = hit_point.material->sample(ray.direction, surface_normal).normalized();
-	Ray          indirect_ray(hit_point.position, indirect_direction);
-	Intersection indirect_hit = intersect(indirect_ray);
-	if (indirect_hit.hit && (!indirect_hit.material->hasEmission())) {
-		vec3f_t indirect_brdf = hit_point.material->eval(ray.direction, indirect_direction, surface_normal);
-		float   pdf = hit_point.material->pdf(ray.direction, indirect_ray.direction, surface_normal);
-		indirect_lighting = castRay(indirect_ray, depth + 1).cwiseProduct(indirect_brdf) * indirect_ray.direction.dot(surface_normal) / pdf / russian_roulette;
+		// traced once here and shaded directly, castRay would intersect the same ray again
+		Ray          indirect_ray(hit_point.position, indirect_direction);
+		indirect_ray.cone_width = cone_width;
+		indirect_ray.cone_spread = ray.cone_spread;
+		Intersection indirect_hit = intersect(indirect_ray);
+		vec3f_t      incident = vec3f_t::Zero();
+		if (stats)
+			stats->bounce_rays++;
+		if (pdf > 0.f && indirect_hit.hit && (!indirect_hit.material->hasEmission())) {
+			vec3f_t indirect_brdf = hit_point.material->eval(ray.direction, indirect_direction, surface_normal, hit_point.texcoord, footprint);
+			incident = shade(indirect_ray, indirect_hit, depth + 1, true);
+			indirect_lighting = incident.cwiseProduct(indirect_brdf) * indirect_ray.direction.dot(surface_normal) / pdf / russian_roulette;
+		}
+
+		if (guide.enabled() && pdf > 0.f)
+			guide.record(hit_position, indirect_direction, incident.mean() / pdf);
 	}
 
-	return direct_lighting + indirect_lighting;
+	// every vertex computed in full feeds the cache, terminated ones included as roulette keeps them unbiased
+	vec3f_t radiance = direct_lighting + indirect_lighting;
+	radiance_cache.add(hit_point.position, surface_normal, radiance);
+
+	return radiance;
 }
 
 bool Scene::trace(const Ray& ray, const std::vector<Primitive*>& primitives, float& tnear, uint32_t& index, Primitive** hit_object)
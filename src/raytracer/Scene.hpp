@@ -2,9 +2,20 @@
 
 #include "Light.hpp"
 #include "BVH.hpp"
+#include "EnvironmentMap.hpp"
+#include "Model.hpp"
+#include "PhotonMap.hpp"
+#include "RadianceCache.hpp"
+#include "SDTree.hpp"
+
+// closest hit of a ray before its surface is resolved, small enough to keep one per camera sample
+struct SurfaceHit {
+	HitRecord record;
+	uint32_t  ref{};
+};
 
 struct Scene {
-	BVHAccel* bvh;
+	BVHAccel* bvh{};
 
 	int width{48};
 	int height{64};
@@ -12,20 +23,69 @@ struct Scene {
 	int   max_depth{3};
 	float russian_roulette{0.8f};
 
-	std::vector<Light*>     lights;
-	std::vector<Primitive*> primitives;
+	// method, leaf size and laziness of the model hierarchies, the scene level keeps one primitive per leaf
+	BVHBuildOptions bvh_options{4};
+
+	// filled and queried by castRay, which is const for every other purpose
+	mutable RadianceCache radiance_cache;
+
+	// caustics through dielectrics, traced pass by pass when photons_per_pass is set
+	PhotonMap photons;
+
+	// learned incident radiance that indirect directions are partly sampled from, recorded into by castRay
+	mutable SDTree guide;
+
+	std::vector<Light*>    lights;
+	std::vector<Material*> materials;
+
+	// primitives are kept per type and addressed through refs, so traversal dispatches without virtual calls
+	std::vector<Triangle>     triangles;
+	std::vector<Sphere>       spheres;
+	std::vector<Model*>       models;
+	std::vector<PrimitiveRef> refs;
+
+	// lights rays that escape the scene, sampled for direct lighting next to the emitters
+	EnvironmentMap environment;
+
+	std::vector<PrimitiveRef> emitters;
+	std::vector<float>        emitter_areas;
+	float                     emit_area_sum{};
 
 	~Scene();
 
+	// triangles and spheres are copied into their arrays and the passed object is released
 	void add(Primitive* primitive);
+	void add(const Triangle& triangle);
+	void add(const Sphere& sphere);
+	void add(Model* model);
 	void add(Light* light);
+	void add(Material* material);
+	void load(const std::string& filepath);
 
 	auto getLights() const -> const std::vector<Light*>&;
-	auto getPrimitives() const -> const std::vector<Primitive*>&;
+
+	template <typename F>
+	decltype(auto) visit(PrimitiveRef ref, F&& f) const;
 
 	void buildBVH();
+	auto closestHit(const Ray& ray, SurfaceHit& hit) const -> bool;
+	auto resolve(const Ray& ray, const SurfaceHit& hit) const -> Intersection;
 	auto intersect(const Ray& ray) const -> Intersection;
 	void sampleLight(Intersection& pos, float& pdf) const;
-	auto castRay(const Ray& ray, int depth) const -> vec3f_t;
+	auto castRay(const Ray& ray, int depth, bool after_diffuse = false) const -> vec3f_t;
+	auto shade(const Ray& ray, const Intersection& hit_point, int depth, bool after_diffuse = false) const -> vec3f_t;
 	bool trace(const Ray& ray, const std::vector<Primitive*>& objects, float& tnear, uint32_t& index, Primitive** hit_object);
 };
+
+template <typename F>
+decltype(auto) Scene::visit(PrimitiveRef ref, F&& f) const
+{
+	switch (ref.type) {
+	case PrimitiveType::TRIANGLE:
+		return f(triangles[ref.index]);
+	case PrimitiveType::SPHERE:
+		return f(spheres[ref.index]);
+	default:
+		return f(*models[ref.index]);
+	}
+}
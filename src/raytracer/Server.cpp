@@ -0,0 +1,162 @@
+#include "Server.hpp"
+
+#include <iostream>
+#include <mutex>
+
+void Server::serve(const std::string& address)
+{
+	Socket listener = Socket::listen(address);
+	if (!listener.valid())
+		exit(1);
+
+	std::cout << "Server listening on " << address << std::endl;
+	while (true) {
+		Socket connection = listener.accept();
+		while (connection.valid() && handle(connection))
+			;
+	}
+}
+
+bool Server::handle(const Socket& connection)
+{
+	MessageType       type;
+	std::vector<char> payload;
+	if (!connection.recvMessage(type, payload) || type != MessageType::RENDER_REQUEST)
+		return false;
+
+	RenderRequest request;
+	size_t        offset = 0;
+	if (!unpack(payload, offset, request))
+		return false;
+	std::string scene_path(payload.begin() + offset, payload.end());
+
+	auto fail = [&](const std::string& message) {
+		std::cerr << "Render request failed: " << message << std::endl;
+		return connection.sendMessage(MessageType::RENDER_ERROR, std::vector<char>(message.begin(), message.end()));
+	};
+
+	if (request.samples_per_pixel <= 0 || request.width < 0 || request.height < 0)
+		return fail("invalid render settings");
+
+	Scene* scene = nullptr;
+	try {
+		scene = acquire(scene_path);
+	} catch (const std::exception& e) {
+		return fail(e.what());
+	}
+
+	Raytracer raytracer;
+	raytracer.first_hit_patterns = first_hit_patterns;
+	raytracer.rasterize_first_hits = rasterize_first_hits;
+	request.camera.apply(raytracer);
+	raytracer.samples_per_pixel = request.samples_per_pixel;
+	if (request.tile_size > 0)
+		raytracer.tile_size = request.tile_size;
+	// the cached scene is shared by later requests, so its resolution is only a default
+	if (request.width > 0 && request.height > 0)
+		raytracer.setup(*scene, request.width, request.height);
+	else
+		raytracer.setup(*scene);
+
+	const int            width = raytracer.width;
+	const int            height = raytracer.height;
+	std::vector<vec3f_t> accumulation(width * height, vec3f_t::Zero());
+	std::mutex           send_mutex;
+	bool                 connected = true;
+
+	// finished tiles are streamed back while the rest of the frame is still rendering
+	raytracer.renderRegion(Tile{0, 0, width, height}, raytracer.samples_per_pixel, accumulation, [&](const Tile& tile) {
+		std::vector<char> data;
+		data.reserve(sizeof(TileHeader) + tile.width() * tile.height() * 3 * sizeof(float));
+		pack(data, TileHeader{tile.x0, tile.y0, tile.x1, tile.y1, width, height});
+		for (int j = tile.y0; j < tile.y1; j++) {
+			for (int i = tile.x0; i < tile.x1; i++) {
+				vec3f_t color = accumulation[j * width + i] / raytracer.samples_per_pixel;
+				pack(data, color.x());
+				pack(data, color.y());
+				pack(data, color.z());
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(send_mutex);
+		connected = connected && connection.sendMessage(MessageType::TILE_DATA, data);
+	});
+
+	return connected && connection.sendMessage(MessageType::RENDER_DONE, {});
+}
+
+Scene* Server::acquire(const std::string& filepath)
+{
+	// only the scene file itself is watched, edits to referenced meshes need a touch of the scene file
+	auto key = std::filesystem::weakly_canonical(filepath).generic_string();
+	auto timestamp = std::filesystem::last_write_time(key);
+
+	if (auto it = scenes.find(key); it != scenes.end() && it->second.timestamp == timestamp)
+		return it->second.scene.get();
+
+	std::cout << "Loading scene " << key << std::endl;
+	auto scene = std::make_unique<Scene>();
+	scene->bvh_options = bvh_options;
+	scene->load(key);
+	if (configure)
+		configure(*scene);
+
+	auto& cached = scenes[key];
+	cached.scene = std::move(scene);
+	cached.timestamp = timestamp;
+
+	return cached.scene.get();
+}
+
+bool Server::request(const std::string& address, const std::string& scene_path, Raytracer& raytracer)
+{
+	Socket connection = Socket::connect(address);
+	if (!connection.valid()) {
+		std::cerr << "Failed to connect to server " << address << std::endl;
+		return false;
+	}
+
+	std::vector<char> payload;
+	pack(payload, RenderRequest{CameraSettings::from(raytracer), raytracer.width, raytracer.height, raytracer.samples_per_pixel, raytracer.tile_size});
+	payload.insert(payload.end(), scene_path.begin(), scene_path.end());
+	if (!connection.sendMessage(MessageType::RENDER_REQUEST, payload))
+		return false;
+
+	MessageType       type;
+	std::vector<char> data;
+	while (connection.recvMessage(type, data)) {
+		if (type == MessageType::RENDER_DONE)
+			return true;
+
+		if (type == MessageType::RENDER_ERROR) {
+			std::cerr << "Server error: " << std::string(data.begin(), data.end()) << std::endl;
+			return false;
+		}
+
+		TileHeader header;
+		size_t     offset = 0;
+		if (type != MessageType::TILE_DATA || !unpack(data, offset, header))
+			return false;
+
+		if (raytracer.framebuffer.size() != static_cast<size_t>(header.width) * header.height) {
+			raytracer.width = header.width;
+			raytracer.height = header.height;
+			raytracer.framebuffer.assign(header.width * header.height, vec3f_t::Zero());
+		}
+
+		if (header.x0 < 0 || header.y0 < 0 || header.x1 > header.width || header.y1 > header.height ||
+		    data.size() != sizeof(header) + static_cast<size_t>(header.x1 - header.x0) * (header.y1 - header.y0) * 3 * sizeof(float))
+			return false;
+
+		for (int j = header.y0; j < header.y1; j++) {
+			for (int i = header.x0; i < header.x1; i++) {
+				auto& color = raytracer.framebuffer[j * header.width + i];
+				unpack(data, offset, color.x());
+				unpack(data, offset, color.y());
+				unpack(data, offset, color.z());
+			}
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "Distributed.hpp"
+
+struct RenderRequest {
+	CameraSettings camera;
+	int32_t        width, height;
+	int32_t        samples_per_pixel;
+	int32_t        tile_size;
+};
+
+struct TileHeader {
+	int32_t x0, y0;
+	int32_t x1, y1;
+	int32_t width, height;
+};
+
+struct CachedScene {
+	std::unique_ptr<Scene>          scene;
+	std::filesystem::file_time_type timestamp;
+};
+
+// long-lived render server keeping loaded scenes and their BVHs warm between requests
+class Server {
+public:
+	std::unordered_map<std::string, CachedScene> scenes;
+
+	// what the command line asked for, applied to every scene as it is loaded and to every request's raytracer
+	BVHBuildOptions             bvh_options{4};
+	std::function<void(Scene&)> configure;
+	int                         first_hit_patterns{1};
+	bool                        rasterize_first_hits{false};
+
+	void serve(const std::string& address);
+	bool handle(const Socket& connection);
+	auto acquire(const std::string& filepath) -> Scene*;
+
+	static bool request(const std::string& address, const std::string& scene_path, Raytracer& raytracer);
+};
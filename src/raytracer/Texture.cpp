@@ -0,0 +1,195 @@
+#include "Texture.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <stb_image.h>
+
+#include "TextureCache.hpp"
+#include "Timeline.hpp"
+
+namespace
+{
+constexpr uint32_t TILE_FILE_MAGIC = 0x43585452;        // "RTXC"
+constexpr uint32_t TILE_FILE_VERSION = 1;
+
+struct TileFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	int32_t  width;
+	int32_t  height;
+	uint64_t num_tiles;
+};
+
+std::atomic<uint32_t> next_texture_id{0};
+
+// last tile each render thread touched, bilinear footprints almost always stay inside one tile
+thread_local uint64_t                           last_tile_key = ~0ull;
+thread_local std::shared_ptr<const TextureTile> last_tile;
+};        // namespace
+
+MipLevel::MipLevel(int width, int height, size_t first_tile) :
+    width(width),
+    height(height),
+    tiles_x((width + TILE_SIZE - 1) / TILE_SIZE),
+    tiles_y((height + TILE_SIZE - 1) / TILE_SIZE),
+    first_tile(first_tile)
+{}
+
+Texture::Texture(const std::string& file_path, TextureType type) :
+    id(next_texture_id++),
+    source(std::make_shared<TileSource>())
+{
+	this->file_path = file_path;
+	this->type = type;
+
+	if (!stbi_info(file_path.c_str(), &this->width, &this->height, &this->nrChannels))
+		throw std::runtime_error("Failed to load texture " + file_path);
+
+	int    level_width = width;
+	int    level_height = height;
+	size_t first_tile = 0;
+	while (true) {
+		const MipLevel& level = levels.emplace_back(level_width, level_height, first_tile);
+		first_tile += static_cast<size_t>(level.tiles_x) * level.tiles_y;
+
+		if (level_width == 1 && level_height == 1)
+			break;
+		level_width = std::max(1, level_width / 2);
+		level_height = std::max(1, level_height / 2);
+	}
+
+	bake();
+}
+
+vec3f_t Texture::sample(float u, float v, float footprint) const
+{
+	return sampleRGBA(u, v, footprint).head<3>();
+}
+
+vec4f_t Texture::sampleRGBA(float u, float v, float footprint) const
+{
+	return TextureSampling::sample(*this, u, v, footprint);
+}
+
+uint32_t Texture::fetch(int level, int x, int y) const
+{
+	constexpr int T = MipLevel::TILE_SIZE;
+	const auto&   texels = tile(level, x / T, y / T);
+
+	return (*texels)[morton(x % T, y % T)];
+}
+
+const std::shared_ptr<const TextureTile>& Texture::tile(int level, int tile_x, int tile_y) const
+{
+	const MipLevel& mip = levels[level];
+	size_t          index = mip.first_tile + static_cast<size_t>(tile_y) * mip.tiles_x + tile_x;
+	uint64_t        key = (static_cast<uint64_t>(id) << 40) | index;
+
+	if (key != last_tile_key) {
+		last_tile = TextureCache::instance().fetch(key, [&]() { return loadTile(index); });
+		last_tile_key = key;
+	}
+
+	return last_tile;
+}
+
+void Texture::bake() const
+{
+	TraceScope scope("texture bake", "texture", file_path);
+
+	// tile files are keyed by source path, size and modification time so they survive between runs
+	namespace fs = std::filesystem;
+
+	std::error_code ec;
+	auto            stamp = fs::last_write_time(file_path, ec).time_since_epoch().count();
+	auto            hash = std::hash<std::string>{}(fs::absolute(file_path, ec).generic_string() + ":" +
+	                                                std::to_string(fs::file_size(file_path, ec)) + ":" + std::to_string(stamp));
+	auto            directory = TextureCache::instance().directory;
+	auto            path = directory / (std::to_string(hash) + ".tiles");
+
+	size_t         num_tiles = levels.back().first_tile + 1;
+	TileFileHeader expected{TILE_FILE_MAGIC, TILE_FILE_VERSION, width, height, num_tiles};
+
+	source->file.open(path, std::ios::binary);
+	if (source->file.is_open()) {
+		TileFileHeader header{};
+		source->file.read(reinterpret_cast<char*>(&header), sizeof(header));
+		if (source->file && std::memcmp(&header, &expected, sizeof(header)) == 0)
+			return;
+		source->file.close();
+	}
+
+	int  image_width, image_height, channels;
+	auto pixels = TextureSampling::decode(file_path, image_width, image_height, channels);
+	if (pixels.empty() || image_width != width || image_height != height)
+		throw std::runtime_error("Failed to load texture " + file_path);
+
+	// build the mip chain from the row-major image and scatter every level into its tiles
+	std::vector<uint32_t> tiles(num_tiles * std::tuple_size_v<TextureTile>, 0);
+
+	for (size_t l = 0; l < levels.size(); l++) {
+		const MipLevel& level = levels[l];
+		constexpr int   T = MipLevel::TILE_SIZE;
+		for (int y = 0; y < level.height; y++)
+			for (int x = 0; x < level.width; x++)
+				tiles[(level.first_tile + static_cast<size_t>(y / T) * level.tiles_x + x / T) * T * T + morton(x % T, y % T)] = pixels[y * level.width + x];
+
+		if (l + 1 == levels.size())
+			break;
+
+		pixels = TextureSampling::downsample(pixels, level.width, level.height);
+	}
+
+	// write to a temporary name first so concurrent renders never read a half-written tile file
+	fs::create_directories(directory, ec);
+	auto temporary = path;
+	temporary += "." + std::to_string(id) + ".tmp";
+	{
+		std::ofstream output(temporary, std::ios::binary);
+		output.write(reinterpret_cast<const char*>(&expected), sizeof(expected));
+		output.write(reinterpret_cast<const char*>(tiles.data()), tiles.size() * sizeof(uint32_t));
+		if (!output)
+			ec = std::make_error_code(std::errc::io_error);
+	}
+	if (!ec)
+		fs::rename(temporary, path, ec);
+
+	if (!ec)
+		source->file.open(path, std::ios::binary);
+	if (!source->file.is_open()) {
+		std::cerr << "Failed to write texture cache " << path.string() << ", keeping " << file_path << " in memory" << std::endl;
+		fs::remove(temporary, ec);
+		TextureCache::instance().pinned += tiles.size() * sizeof(uint32_t);
+		source->resident = std::move(tiles);
+	}
+}
+
+TileSource::~TileSource()
+{
+	TextureCache::instance().pinned -= resident.size() * sizeof(uint32_t);
+}
+
+std::shared_ptr<const TextureTile> Texture::loadTile(size_t index) const
+{
+	auto tile = std::make_shared<TextureTile>();
+	if (!source->resident.empty()) {
+		std::memcpy(tile->data(), source->resident.data() + index * tile->size(), sizeof(TextureTile));
+		return tile;
+	}
+
+	std::lock_guard<std::mutex> lock(source->mutex);
+	source->file.seekg(static_cast<std::streamoff>(sizeof(TileFileHeader) + index * sizeof(TextureTile)));
+	source->file.read(reinterpret_cast<char*>(tile->data()), sizeof(TextureTile));
+	if (!source->file) {
+		std::cerr << "Failed to read texture tile " << index << " of " << file_path << std::endl;
+		source->file.clear();
+		tile->fill(0);
+	}
+
+	return tile;
+}
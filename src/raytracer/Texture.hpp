@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "global.hpp"
+#include "TextureSampling.hpp"
+
+// one mip level of RGBA8 texels, split into TILE_SIZE x TILE_SIZE tiles with Morton order inside each tile
+struct MipLevel {
+	static constexpr int TILE_SIZE = 32;
+
+	int    width;
+	int    height;
+	int    tiles_x;
+	int    tiles_y;
+	size_t first_tile;
+
+	MipLevel(int width, int height, size_t first_tile);
+};
+
+using TextureTile = std::array<uint32_t, MipLevel::TILE_SIZE * MipLevel::TILE_SIZE>;
+
+// baked tiles of a texture, either in a tile file of the texture cache directory or in memory as a fallback that
+// counts against the texture cache's budget
+struct TileSource {
+	std::mutex            mutex;
+	std::ifstream         file;
+	std::vector<uint32_t> resident;
+
+	~TileSource();
+};
+
+struct Texture {
+	int width;
+	int height;
+	int nrChannels;
+
+	std::string           file_path;
+	TextureType           type;
+	TextureFilter         filter{TextureFilter::TRILINEAR};
+	std::vector<MipLevel> levels;
+
+	uint32_t                    id;
+	std::shared_ptr<TileSource> source;
+
+	// decodes the image into a tile file once, on the loading thread; samples then page tiles in on demand
+	Texture(const std::string& file_path, TextureType type);
+
+	// footprint is the uv-space area covered by one pixel or ray, zero samples the base level
+	vec3f_t sample(float u, float v, float footprint = 0.f) const;
+	vec4f_t sampleRGBA(float u, float v, float footprint = 0.f) const;
+
+	auto fetch(int level, int x, int y) const -> uint32_t;
+	// the returned reference stays valid until the calling thread fetches another tile
+	auto tile(int level, int tile_x, int tile_y) const -> const std::shared_ptr<const TextureTile>&;
+
+	void bake() const;
+	auto loadTile(size_t index) const -> std::shared_ptr<const TextureTile>;
+};
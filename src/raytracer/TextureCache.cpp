@@ -0,0 +1,70 @@
+#include "TextureCache.hpp"
+
+#include <iostream>
+
+std::shared_ptr<const TextureTile> TextureCache::lookup(uint64_t key)
+{
+	Shard&                      shard = shards[key % NUM_SHARDS];
+	std::lock_guard<std::mutex> lock(shard.mutex);
+
+	auto it = shard.entries.find(key);
+	if (it == shard.entries.end())
+		return nullptr;
+
+	shard.lru.splice(shard.lru.begin(), shard.lru, it->second.position);
+	return it->second.tile;
+}
+
+std::shared_ptr<const TextureTile> TextureCache::insert(uint64_t key, std::shared_ptr<const TextureTile> tile)
+{
+	Shard&                      shard = shards[key % NUM_SHARDS];
+	std::lock_guard<std::mutex> lock(shard.mutex);
+
+	if (auto it = shard.entries.find(key); it != shard.entries.end())
+		return it->second.tile;
+
+	shard.lru.push_front(key);
+	shard.entries.emplace(key, Entry{tile, shard.lru.begin()});
+	shard.bytes += sizeof(TextureTile);
+
+	// tiles still held by a sampling thread stay alive through their shared_ptr after eviction
+	size_t available = budget - std::min<size_t>(pinned, budget);
+	size_t shard_budget = std::max(available / NUM_SHARDS, sizeof(TextureTile));
+	while (shard.bytes > shard_budget && shard.lru.size() > 1) {
+		shard.entries.erase(shard.lru.back());
+		shard.lru.pop_back();
+		shard.bytes -= sizeof(TextureTile);
+		evictions++;
+	}
+
+	return tile;
+}
+
+size_t TextureCache::residentBytes()
+{
+	size_t bytes = 0;
+	for (auto& shard : shards) {
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		bytes += shard.bytes;
+	}
+
+	return bytes;
+}
+
+void TextureCache::report()
+{
+	if (hits + misses == 0)
+		return;
+
+	std::cout << "Texture cache: " << hits << " hits, " << misses << " misses, " << evictions << " evictions, "
+	          << residentBytes() / (1 << 20) << " / " << budget / (1 << 20) << " MB resident";
+	if (pinned > 0)
+		std::cout << ", " << pinned / (1 << 20) << " MB pinned without a tile file";
+	std::cout << std::endl;
+}
+
+TextureCache& TextureCache::instance()
+{
+	static TextureCache cache;
+	return cache;
+}
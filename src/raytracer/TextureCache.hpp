@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "Texture.hpp"
+
+// process-wide cache of texture tiles with a fixed memory budget and LRU eviction
+class TextureCache {
+private:
+	static constexpr int NUM_SHARDS = 16;
+
+	struct Entry {
+		std::shared_ptr<const TextureTile> tile;
+		std::list<uint64_t>::iterator      position;
+	};
+
+	// each shard keeps its own recency list so render threads rarely contend on the same lock
+	struct Shard {
+		std::mutex                          mutex;
+		std::list<uint64_t>                 lru;
+		std::unordered_map<uint64_t, Entry> entries;
+		size_t                              bytes{0};
+	};
+
+	std::array<Shard, NUM_SHARDS> shards;
+
+	auto lookup(uint64_t key) -> std::shared_ptr<const TextureTile>;
+	auto insert(uint64_t key, std::shared_ptr<const TextureTile> tile) -> std::shared_ptr<const TextureTile>;
+
+public:
+	size_t                budget{256ull << 20};
+	std::filesystem::path directory{std::filesystem::temp_directory_path() / "rasyer-texture-cache"};
+
+	// bytes of textures kept in memory because their tile file could not be written, taken off the budget
+	std::atomic<size_t> pinned{0};
+
+	std::atomic<size_t> hits{0};
+	std::atomic<size_t> misses{0};
+	std::atomic<size_t> evictions{0};
+
+	template <typename F>
+	auto fetch(uint64_t key, F&& load) -> std::shared_ptr<const TextureTile>
+	{
+		if (auto tile = lookup(key)) {
+			hits++;
+			return tile;
+		}
+
+		// tiles load outside the shard lock, a racing thread's copy simply wins the insert
+		misses++;
+		return insert(key, load());
+	}
+
+	auto residentBytes() -> size_t;
+	void report();
+
+	static TextureCache& instance();
+};
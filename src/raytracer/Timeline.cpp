@@ -0,0 +1,125 @@
+#include "Timeline.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+Timeline::Lease::~Lease()
+{
+	if (!buffer)
+		return;
+
+	Timeline&                   timeline = Timeline::instance();
+	std::lock_guard<std::mutex> lock(timeline.mutex);
+	timeline.idle.push_back(buffer);
+}
+
+Timeline::Buffer& Timeline::buffer()
+{
+	// buffers outlive their threads so events of finished render threads are still written, a later thread
+	// appends to the ring of one that finished, showing up on its track
+	thread_local Lease local;
+	if (!local.buffer) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!idle.empty()) {
+			local.buffer = idle.back();
+			idle.pop_back();
+		} else {
+			buffers.push_back(std::make_unique<Buffer>());
+			local.buffer = buffers.back().get();
+			local.buffer->thread_id = static_cast<uint32_t>(buffers.size());
+		}
+	}
+
+	return *local.buffer;
+}
+
+int64_t Timeline::now() const
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void Timeline::record(const char* name, const char* category, std::string_view detail, int64_t begin, int64_t end)
+{
+	Buffer&  target = buffer();
+	uint64_t head = target.head.load(std::memory_order_relaxed);
+
+	TraceEvent& event = target.events[head % CAPACITY];
+	event.name = name;
+	event.category = category;
+	event.begin = begin;
+	event.duration = end - begin;
+
+	size_t length = std::min(detail.size(), event.detail.size() - 1);
+	std::memcpy(event.detail.data(), detail.data(), length);
+	event.detail[length] = '\0';
+
+	target.head.store(head + 1, std::memory_order_release);
+}
+
+void Timeline::write(const std::string& filename)
+{
+	std::ofstream file(filename);
+	if (!file.is_open()) {
+		std::cerr << "Failed to open trace file " << filename << std::endl;
+		return;
+	}
+
+	auto escape = [](const char* text) {
+		std::string escaped;
+		for (; *text; text++) {
+			if (*text == '"' || *text == '\\')
+				escaped += '\\';
+			escaped += static_cast<unsigned char>(*text) < 0x20 ? ' ' : *text;
+		}
+		return escaped;
+	};
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+	bool first = true;
+	for (const auto& source : buffers) {
+		uint64_t head = source->head.load(std::memory_order_acquire);
+		for (uint64_t i = head > CAPACITY ? head - CAPACITY : 0; i < head; i++) {
+			const TraceEvent& event = source->events[i % CAPACITY];
+			file << (first ? "\n" : ",\n")
+			     << "{\"name\": \"" << event.name << "\", \"cat\": \"" << event.category << "\", \"ph\": \"X\""
+			     << ", \"ts\": " << event.begin << ", \"dur\": " << event.duration
+			     << ", \"pid\": 1, \"tid\": " << source->thread_id;
+			if (event.detail[0])
+				file << ", \"args\": {\"detail\": \"" << escape(event.detail.data()) << "\"}";
+			file << "}";
+			first = false;
+		}
+	}
+	file << "\n]}" << std::endl;
+}
+
+Timeline& Timeline::instance()
+{
+	static Timeline timeline;
+	return timeline;
+}
+
+TraceScope::TraceScope(const char* name, const char* category, std::string_view detail) :
+    name(name),
+    category(category)
+{
+	Timeline& timeline = Timeline::instance();
+	if (!timeline.enabled.load(std::memory_order_relaxed))
+		return;
+
+	this->detail = detail;
+	begin = timeline.now();
+}
+
+TraceScope::~TraceScope()
+{
+	if (begin < 0)
+		return;
+
+	Timeline& timeline = Timeline::instance();
+	timeline.record(name, category, detail, begin, timeline.now());
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// one complete event, detail is truncated to fit the fixed record
+struct TraceEvent {
+	const char*          name;
+	const char*          category;
+	int64_t              begin;
+	int64_t              duration;
+	std::array<char, 64> detail;
+};
+
+// process-wide record of scoped events in per-thread ring buffers, written as Chrome Trace Event JSON
+class Timeline {
+private:
+	static constexpr size_t CAPACITY = 1 << 14;
+
+	// only the owning thread appends, older events are overwritten once the ring is full
+	struct Buffer {
+		uint32_t                         thread_id;
+		std::array<TraceEvent, CAPACITY> events;
+		std::atomic<uint64_t>            head{0};
+	};
+
+	// held by a recording thread and handed back when it exits, so threads started per pass reuse the rings
+	struct Lease {
+		Buffer* buffer{};
+		~Lease();
+	};
+
+	std::mutex                           mutex;
+	std::vector<std::unique_ptr<Buffer>> buffers;
+	std::vector<Buffer*>                 idle;
+
+	auto buffer() -> Buffer&;
+
+public:
+	std::atomic<bool>                     enabled{false};
+	std::chrono::steady_clock::time_point start{std::chrono::steady_clock::now()};
+
+	auto now() const -> int64_t;
+	void record(const char* name, const char* category, std::string_view detail, int64_t begin, int64_t end);
+	void write(const std::string& filename);
+
+	static Timeline& instance();
+};
+
+// records its own lifetime as one event when the timeline is enabled
+class TraceScope {
+private:
+	const char* name;
+	const char* category;
+	std::string detail;
+	int64_t     begin{-1};
+
+public:
+	TraceScope(const char* name, const char* category, std::string_view detail = {});
+	~TraceScope();
+
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+};
@@ -0,0 +1,56 @@
+#include "TraceStats.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+void TraceStats::merge(const TraceStats& other)
+{
+	node_visits += other.node_visits;
+	box_tests += other.box_tests;
+	primitive_tests += other.primitive_tests;
+	camera_rays += other.camera_rays;
+	shadow_rays += other.shadow_rays;
+	bounce_rays += other.bounce_rays;
+	for (int i = 0; i < MAX_PATH_LENGTH; i++)
+		path_depths[i] += other.path_depths[i];
+	traversal_counters += other.traversal_counters;
+	render_counters += other.render_counters;
+}
+
+void TraceStats::report() const
+{
+	uint64_t rays = camera_rays + shadow_rays + bounce_rays;
+	if (rays == 0)
+		return;
+
+	std::cout << "Rays: " << camera_rays << " camera, " << shadow_rays << " shadow, " << bounce_rays << " bounce" << std::endl;
+	std::cout << "Per ray: " << static_cast<double>(node_visits) / rays << " node visits, "
+	          << static_cast<double>(box_tests) / rays << " box tests, "
+	          << static_cast<double>(primitive_tests) / rays << " primitive tests" << std::endl;
+
+	// a path ends at depth d when it reached d but not d + 1
+	std::cout << "Path lengths:";
+	for (int depth = 0; depth < MAX_PATH_LENGTH && path_depths[depth] > 0; depth++) {
+		uint64_t deeper = depth + 1 < MAX_PATH_LENGTH ? path_depths[depth + 1] : 0;
+		std::cout << " " << depth + 1 << ": " << path_depths[depth] - deeper;
+	}
+	std::cout << std::endl;
+
+	if (render_counters.cycles == 0)
+		return;
+
+	auto counters = [](const char* phase, const PerfSample& sample, uint64_t count, const char* unit) {
+		std::cout << phase << ": IPC " << sample.ipc() << ", per " << unit << " "
+		          << static_cast<double>(sample.l1_misses) / count << " L1 misses, "
+		          << static_cast<double>(sample.llc_misses) / count << " LLC misses, "
+		          << static_cast<double>(sample.branch_misses) / count << " branch misses" << std::endl;
+	};
+	counters("Traversal", traversal_counters, rays, "ray");
+	counters("Shading", render_counters - traversal_counters, std::max<uint64_t>(camera_rays, 1), "sample");
+}
+
+TraceStats& TraceStats::local()
+{
+	thread_local TraceStats stats;
+	return stats;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "PerfCounters.hpp"
+
+// traversal and path counters of one render thread, merged into Raytracer::stats when the thread finishes;
+// counting only happens while enabled is set
+struct TraceStats {
+	static constexpr int MAX_PATH_LENGTH = 16;
+
+	uint64_t node_visits{};
+	uint64_t box_tests{};
+	uint64_t primitive_tests{};
+
+	uint64_t camera_rays{};
+	uint64_t shadow_rays{};
+	uint64_t bounce_rays{};
+
+	// paths that reached each bounce depth, the last bucket also counts deeper ones
+	std::array<uint64_t, MAX_PATH_LENGTH> path_depths{};
+
+	// hardware counts inside Scene::intersect and over whole tiles, the difference is shading
+	PerfSample traversal_counters;
+	PerfSample render_counters;
+
+	static inline bool enabled{false};
+
+	auto cost() const -> uint64_t { return box_tests + primitive_tests; }
+	void merge(const TraceStats& other);
+	void report() const;
+
+	static auto local() -> TraceStats&;
+
+	// traversals count into locals and add them once per ray
+	static void traversal(uint32_t visits, uint32_t boxes, uint32_t primitives)
+	{
+		if (!enabled)
+			return;
+
+		TraceStats& stats = local();
+		stats.node_visits += visits;
+		stats.box_tests += boxes;
+		stats.primitive_tests += primitives;
+	}
+};
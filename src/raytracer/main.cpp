@@ -1,23 +1,316 @@
 #include <chrono>
 #include <iostream>
+#include <sstream>
 
 #include "Raytracer.hpp"
+#include "Baker.hpp"
+#include "Distributed.hpp"
+#include "Server.hpp"
+#include "TextureCache.hpp"
+#include "GeometryCache.hpp"
 #include "Model.hpp"
+#include "ThreadPool.hpp"
+#include "Timeline.hpp"
 
 void init(Scene& scene);
 
+std::vector<std::string> splitList(const std::string& list)
+{
+	std::vector<std::string> items;
+	std::stringstream        stream(list);
+	for (std::string item; std::getline(stream, item, ',');)
+		if (!item.empty())
+			items.push_back(item);
+
+	return items;
+}
+
+vec3f_t parseVector(const std::string& list)
+{
+	auto items = splitList(list);
+	if (items.size() != 3)
+		throw std::invalid_argument("expected x,y,z but got " + list);
+
+	return vec3f_t(std::stof(items[0]), std::stof(items[1]), std::stof(items[2]));
+}
+
+void usage(const char* program)
+{
+	std::cerr << "Usage: " << program << " [options]\n"
+	          << "  --scene <file>                     load a scene file instead of the built-in Cornell box\n"
+	          << "  --output <file>                    write the rendered image to <file>\n"
+	          << "  --size <width>x<height>            override the scene resolution\n"
+	          << "  --spp <n>                          samples per pixel\n"
+	          << "  --first-hit-patterns <n>           cache primary hits at n fixed positions per pixel, 0 traces every sample\n"
+	          << "  --primary <trace|raster>           trace the cached primary hits or rasterize them at setup\n"
+	          << "  --camera <x,y,z>                   camera position\n"
+	          << "  --target <x,y,z>                   point the camera looks at\n"
+	          << "  --fov <degrees>                    vertical field of view\n"
+	          << "  --texture-cache <MB>               memory budget for resident texture tiles\n"
+	          << "  --geometry-cache <MB>              stream model geometry from disk within this memory budget\n"
+	          << "  --bvh <naive|sah|sbvh>             BVH build method, sbvh adds spatial splits\n"
+	          << "  --bvh-build <eager|lazy>           build BVHs up front or as rays reach them\n"
+	          << "  --bvh-duplication <fraction>       extra primitive references sbvh may create\n"
+	          << "  --bvh-optimize <passes>            treelet restructuring passes after the build\n"
+	          << "  --bvh-nodes <full|compressed>      keep float BVH nodes or quantize them to 8 bits\n"
+	          << "  --radiance-cache <resolution>      end paths at cached radiance, cells are the scene diagonal / resolution\n"
+	          << "  --radiance-cache-depth <n>         first bounce that may end at the radiance cache\n"
+	          << "  --photons <count>                  trace this many photons per sample pass for caustics through dielectrics\n"
+	          << "  --photon-radius <fraction>         initial photon gather radius as a fraction of the scene diagonal\n"
+	          << "  --guiding <on|off>                 learn where indirect light comes from over doubling passes and sample it\n"
+	          << "  --bake <obj>                       bake --spp samples of lighting from the scene into the obj's vertex colors\n"
+	          << "  --bake-output <obj>                where the baked obj goes, <name>_baked.obj next to the input by default\n"
+	          << "  --trace <file>                     write a Chrome trace of load, build, render and save phases\n"
+	          << "  --stats <on|off>                   count traversal work and write a cost heatmap next to the output\n"
+	          << "  --perf <on|off>                    read hardware counters around traversal and shading, implies --stats\n"
+	          << "  --worker <address>                 serve tile jobs for a coordinator\n"
+	          << "  --coordinator <address>[,...]      distribute the frame over workers\n"
+	          << "  --server <address>                 serve render requests, keeping scenes cached\n"
+	          << "  --client <address>                 send the render request for --scene to a server\n"
+	          << "Addresses are either unix:<path> or <host>:<port>." << std::endl;
+}
+
 int main(int argc, const char* argv[])
 {
+	std::string scene_path;
+	std::string output_path = BUILD_RPATH "/cornellbox.ppm";
+	std::string worker_address;
+	std::string coordinator_workers;
+	std::string server_address;
+	std::string client_address;
+	std::string trace_path;
+	int         width = 0, height = 0;
+	float       radiance_cache_resolution = 0.f;
+	int         radiance_cache_depth = 1;
+	size_t      photon_count = 0;
+	float       photon_radius = 0.01f;
+	bool        guiding = false;
+	std::string bake_path;
+	std::string bake_output;
+
+	BVHBuildOptions bvh_options{4};
+	Raytracer       raytracer;
+
+	try {
+		for (int i = 1; i < argc; i++) {
+			std::string arg = argv[i];
+			if (i + 1 >= argc) {
+				usage(argv[0]);
+				return 1;
+			}
+
+			std::string value = argv[++i];
+			if (arg == "--scene")
+				scene_path = value;
+			else if (arg == "--output")
+				output_path = value;
+			else if (arg == "--size" && value.find('x') != std::string::npos) {
+				width = std::stoi(value.substr(0, value.find('x')));
+				height = std::stoi(value.substr(value.find('x') + 1));
+			} else if (arg == "--spp")
+				raytracer.samples_per_pixel = std::stoi(value);
+			else if (arg == "--first-hit-patterns")
+				raytracer.first_hit_patterns = std::max(0, std::stoi(value));
+			else if (arg == "--primary" && (value == "trace" || value == "raster"))
+				raytracer.rasterize_first_hits = value == "raster";
+			else if (arg == "--camera")
+				raytracer.camera_position = parseVector(value);
+			else if (arg == "--target")
+				raytracer.camera_target = parseVector(value);
+			else if (arg == "--fov")
+				raytracer.fov = std::stof(value);
+			else if (arg == "--texture-cache")
+				TextureCache::instance().budget = static_cast<size_t>(std::stoul(value)) << 20;
+			else if (arg == "--geometry-cache")
+				GeometryCache::instance().budget = static_cast<size_t>(std::stoul(value)) << 20;
+			else if (arg == "--bvh" && value == "naive")
+				bvh_options.method = BVHBuildMethod::NAIVE;
+			else if (arg == "--bvh" && value == "sah")
+				bvh_options.method = BVHBuildMethod::SAH;
+			else if (arg == "--bvh" && value == "sbvh")
+				bvh_options.method = BVHBuildMethod::SBVH;
+			else if (arg == "--bvh-build" && (value == "eager" || value == "lazy"))
+				bvh_options.lazy = value == "lazy";
+			else if (arg == "--bvh-duplication")
+				bvh_options.duplication_budget = std::stof(value);
+			else if (arg == "--bvh-optimize")
+				bvh_options.optimize_passes = std::stoi(value);
+			else if (arg == "--bvh-nodes" && (value == "full" || value == "compressed"))
+				bvh_options.compress = value == "compressed";
+			else if (arg == "--radiance-cache")
+				radiance_cache_resolution = std::stof(value);
+			else if (arg == "--radiance-cache-depth")
+				radiance_cache_depth = std::max(1, std::stoi(value));
+			else if (arg == "--photons")
+				photon_count = std::stoull(value);
+			else if (arg == "--photon-radius")
+				photon_radius = std::stof(value);
+			else if (arg == "--guiding" && (value == "on" || value == "off"))
+				guiding = value == "on";
+			else if (arg == "--bake")
+				bake_path = value;
+			else if (arg == "--bake-output")
+				bake_output = value;
+			else if (arg == "--trace")
+				trace_path = value;
+			else if (arg == "--stats" && (value == "on" || value == "off"))
+				TraceStats::enabled = value == "on";
+			else if (arg == "--perf" && (value == "on" || value == "off"))
+				PerfCounters::enabled = value == "on";
+			else if (arg == "--worker")
+				worker_address = value;
+			else if (arg == "--coordinator")
+				coordinator_workers = value;
+			else if (arg == "--server")
+				server_address = value;
+			else if (arg == "--client")
+				client_address = value;
+			else {
+				usage(argv[0]);
+				return 1;
+			}
+		}
+	} catch (const std::exception& e) {
+		std::cerr << "Invalid argument: " << e.what() << std::endl;
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (raytracer.rasterize_first_hits && raytracer.first_hit_patterns == 0) {
+		std::cerr << "Invalid argument: --primary raster fills the first hit cache, which --first-hit-patterns 0 disables" << std::endl;
+		return 1;
+	}
+
+	// lazy trees are still growing while rays traverse them, so they cannot be restructured, quantized or split spatially
+	if (bvh_options.lazy && (bvh_options.method == BVHBuildMethod::SBVH || bvh_options.optimize_passes > 0 || bvh_options.compress)) {
+		std::cerr << "Invalid argument: --bvh-build lazy builds object splits only, without --bvh sbvh, --bvh-optimize or --bvh-nodes compressed" << std::endl;
+		return 1;
+	}
+
+	Timeline::instance().enabled = !trace_path.empty();
+	if (PerfCounters::enabled) {
+		TraceStats::enabled = true;
+		if (!PerfCounters::local().available())
+			std::cerr << "Hardware counters are unavailable, build with RASYER_PERF_COUNTERS on Linux and check perf_event_paranoid" << std::endl;
+	}
+
+	// tile jobs render independent sample counts, but each photon pass must cover the whole frame
+	if (photon_count > 0 && (!worker_address.empty() || !coordinator_workers.empty())) {
+		std::cerr << "Invalid argument: --photons traces a photon pass per frame pass, which --worker and --coordinator do not run" << std::endl;
+		return 1;
+	}
+
+	// the SD-tree is refined between passes over the whole frame, workers only ever see tiles
+	if (guiding && (!worker_address.empty() || !coordinator_workers.empty())) {
+		std::cerr << "Invalid argument: --guiding refines between frame passes, which --worker and --coordinator do not run" << std::endl;
+		return 1;
+	}
+
+	// applied to a scene once it is loaded, since the cache cells and the photon radius follow its bounds
+	auto configure = [&](Scene& scene) {
+		// a million cells, plenty for interiors at the resolutions that keep the bias small
+		if (radiance_cache_resolution > 0.f) {
+			scene.radiance_cache.reset(1 << 20, scene.bvh->root_bound.diagonal().norm() / radiance_cache_resolution);
+			scene.radiance_cache.query_depth = radiance_cache_depth;
+		}
+
+		scene.photons.photons_per_pass = photon_count;
+		scene.photons.initial_radius = scene.bvh->root_bound.diagonal().norm() * photon_radius;
+		if (guiding)
+			scene.guide.reset(scene.bvh->root_bound);
+	};
+
+	if (!server_address.empty()) {
+		// requests stream tiles of a single pass, while photons and guiding need the pass loop of Raytracer::render
+		if (photon_count > 0 || guiding) {
+			std::cerr << "Invalid argument: --photons and --guiding render in passes, which --server does not run" << std::endl;
+			return 1;
+		}
+
+		Server server;
+		server.bvh_options = bvh_options;
+		server.configure = configure;
+		server.first_hit_patterns = raytracer.first_hit_patterns;
+		server.rasterize_first_hits = raytracer.rasterize_first_hits;
+		server.serve(server_address);
+		return 0;
+	}
+
+	if (!client_address.empty()) {
+		if (scene_path.empty()) {
+			std::cerr << "--client needs a --scene to request" << std::endl;
+			return 1;
+		}
+
+		raytracer.width = width;
+		raytracer.height = height;
+		if (!Server::request(client_address, std::filesystem::absolute(scene_path).generic_string(), raytracer))
+			return 1;
+		raytracer.save(output_path);
+		return 0;
+	}
+
 	Scene scene;
-	init(scene);
+	scene.bvh_options = bvh_options;
+	try {
+		if (scene_path.empty())
+			init(scene);
+		else
+			scene.load(scene_path);
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+
+	if (width > 0 && height > 0) {
+		scene.width = width;
+		scene.height = height;
+	}
+
+	configure(scene);
+
+	if (!bake_path.empty()) {
+		Baker baker;
+		baker.samples_per_vertex = raytracer.samples_per_pixel;
+		try {
+			baker.bake(scene, bake_path, bake_output.empty() ? Baker::defaultOutput(bake_path) : bake_output);
+		} catch (const std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return 1;
+		}
+		if (!trace_path.empty())
+			Timeline::instance().write(trace_path);
+		return 0;
+	}
+
+	if (!worker_address.empty()) {
+		Worker worker(scene);
+		worker.serve(worker_address);
+		return 0;
+	}
 
 	auto start = std::chrono::system_clock::now();
 
-	Raytracer raytracer;
-	raytracer.render(scene);
-	raytracer.save(BUILD_RPATH "/cornellbox.ppm");
+	if (!coordinator_workers.empty()) {
+		Coordinator coordinator(splitList(coordinator_workers));
+		coordinator.render(raytracer, scene);
+	} else
+		raytracer.render(scene);
+	raytracer.save(output_path);
+	if (TraceStats::enabled) {
+		raytracer.stats.report();
+		raytracer.saveHeatmap(std::filesystem::path(output_path).replace_extension(".heatmap.ppm").generic_string());
+	}
+	BVHOptimizeTotals::instance().report();
+	TextureCache::instance().report();
+	GeometryCache::instance().report();
+	scene.radiance_cache.report();
+	scene.photons.report();
+	scene.guide.report();
 
 	auto stop = std::chrono::system_clock::now();
+	if (!trace_path.empty())
+		Timeline::instance().write(trace_path);
 
 	std::cout << std::flush;
 	std::cout << "Render takes: " << std::chrono::duration_cast<std::chrono::seconds>(stop - start).count() << " seconds." << std::endl;
@@ -40,19 +333,26 @@ void init(Scene& scene)
 	light->emission = vec3f_t(47.8348f, 38.5664f, 31.0808f);
 	light->kd = vec3f_t(0.65f, 0.65f, 0.65f);
 
-	auto* floor_mesh = new Model(PROJECT_PATH "/assets/cornellbox/floor.obj", white);
-	auto* shortbox_mesh = new Model(PROJECT_PATH "/assets/cornellbox/shortbox.obj", white);
-	auto* tallbox_mesh = new Model(PROJECT_PATH "/assets/cornellbox/tallbox.obj", white);
-	auto* left_mesh = new Model(PROJECT_PATH "/assets/cornellbox/left.obj", red);
-	auto* right_mesh = new Model(PROJECT_PATH "/assets/cornellbox/right.obj", green);
-	auto* light_mesh = new Model(PROJECT_PATH "/assets/cornellbox/light.obj", light);
-
-	scene.add(floor_mesh);
-	scene.add(shortbox_mesh);
-	scene.add(tallbox_mesh);
-	scene.add(left_mesh);
-	scene.add(right_mesh);
-	scene.add(light_mesh);
+	scene.add(red);
+	scene.add(green);
+	scene.add(white);
+	scene.add(light);
+
+	// the scene's options, as Scene::load passes them, since streamed models are not rebuilt by buildBVH
+	auto floor_mesh = Model::load(PROJECT_PATH "/assets/cornellbox/floor.obj", white, scene.bvh_options);
+	auto shortbox_mesh = Model::load(PROJECT_PATH "/assets/cornellbox/shortbox.obj", white, scene.bvh_options);
+	auto tallbox_mesh = Model::load(PROJECT_PATH "/assets/cornellbox/tallbox.obj", white, scene.bvh_options);
+	auto left_mesh = Model::load(PROJECT_PATH "/assets/cornellbox/left.obj", red, scene.bvh_options);
+	auto right_mesh = Model::load(PROJECT_PATH "/assets/cornellbox/right.obj", green, scene.bvh_options);
+	auto light_mesh = Model::load(PROJECT_PATH "/assets/cornellbox/light.obj", light, scene.bvh_options);
+
+	auto& pool = ThreadPool::instance();
+	scene.add(pool.wait(floor_mesh));
+	scene.add(pool.wait(shortbox_mesh));
+	scene.add(pool.wait(tallbox_mesh));
+	scene.add(pool.wait(left_mesh));
+	scene.add(pool.wait(right_mesh));
+	scene.add(pool.wait(light_mesh));
 
 	scene.buildBVH();
 }